@@ -0,0 +1,342 @@
+// chip8-aot: translate a ROM's reachable code into a C++ translation unit.
+//
+//   chip8-aot rom.ch8 out.cpp [symbol]
+//
+// The output defines `extern const AotProgram <symbol>` (default
+// CHIP8_AOT_PROGRAM). Compile it into a program that links chip8.cpp and
+// call chip8.AttachAot(&symbol) after LoadRom, with chip8.core = Core::Aot.
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+#include "jit.hpp"
+
+static const int MAX_BLOCK_INSTRS = 64;
+
+static const char *OP_NAMES[OP_COUNT] = {
+    "OPNULL", "OP00E0", "OP00EE", "OP1nnn", "OP2nnn", "OP3xkk", "OP4xkk", "OP5xy0",
+    "OP6xkk", "OP7xkk", "OP8xy0", "OP8xy1", "OP8xy2", "OP8xy3", "OP8xy4", "OP8xy5",
+    "OP8xy6", "OP8xy7", "OP8xyE", "OP9xy0", "OPAnnn", "OPBnnn", "OPCxkk", "OPDxyn",
+    "OPEx9E", "OPExA1", "OPFx07", "OPFx0A", "OPFx15", "OPFx18", "OPFx1E", "OPFx29",
+    "OPFx33", "OPFx55", "OPFx65"};
+
+static const char *OP_ENUMS[OP_COUNT] = {
+    "OP_NULL", "OP_00E0", "OP_00EE", "OP_1nnn", "OP_2nnn", "OP_3xkk", "OP_4xkk", "OP_5xy0",
+    "OP_6xkk", "OP_7xkk", "OP_8xy0", "OP_8xy1", "OP_8xy2", "OP_8xy3", "OP_8xy4", "OP_8xy5",
+    "OP_8xy6", "OP_8xy7", "OP_8xyE", "OP_9xy0", "OP_Annn", "OP_Bnnn", "OP_Cxkk", "OP_Dxyn",
+    "OP_Ex9E", "OP_ExA1", "OP_Fx07", "OP_Fx0A", "OP_Fx15", "OP_Fx18", "OP_Fx1E", "OP_Fx29",
+    "OP_Fx33", "OP_Fx55", "OP_Fx65"};
+
+struct Block
+{
+    uint16_t start;
+    uint16_t end;
+    uint16_t count;
+    std::string body;
+    std::string resume; // switch cases for entries past the first instruction
+};
+
+// Same conditions under which Chip8::Fetch stops, plus unknown opcodes
+static Instr const *Walkable(Chip8 &chip, uint32_t addr)
+{
+    if (addr < chip.START_ADRESS || addr >= 4095)
+        return nullptr;
+    if (chip.decoded[addr].op == OP_UNDECODED)
+        chip.Decode(addr);
+
+    Instr const &in = chip.decoded[addr];
+    if (in.opcode == 0 || in.op == OP_NULL)
+        return nullptr;
+    return &in;
+}
+
+static std::string Hex(unsigned v)
+{
+    char buf[16];
+    snprintf(buf, sizeof(buf), "0x%x", v);
+    return buf;
+}
+
+// Translate the block at start; successors found on the way go to `todo`
+static Block Translate(Chip8 &chip, uint16_t start, std::vector<uint16_t> &todo,
+                       std::map<uint16_t, std::string> &operands)
+{
+    Block block{start, start, 0, "", ""};
+    std::ostringstream body;
+    std::ostringstream resume;
+
+    uint16_t addr = start;
+    bool pcSet = false;
+    bool opcodeSet = false;
+    uint16_t lastOpcode = 0;
+
+    // Instructions whose cycles have not been added to c.cycles yet
+    unsigned pending = 0;
+
+    while (block.count < MAX_BLOCK_INSTRS)
+    {
+        Instr const *p = Walkable(chip, addr);
+        if (!p)
+            break;
+
+        Instr const &in = *p;
+
+        // Out of budget before this instruction: leave the state of an
+        // interpreter stopped here. The next step resumes at the same point,
+        // with the cycles it did not run taken back and the budget counted
+        // from the block start.
+        if (block.count > 0)
+        {
+            std::string label = "L_" + Hex(addr).substr(2);
+            resume << "    case " << Hex(addr) << ":\n";
+            if (pending > 0)
+                resume << "        c.cycles -= " << pending << ";\n";
+            resume << "        budget += " << block.count << ";\n";
+            resume << "        goto " << label << ";\n";
+
+            body << label << ":\n";
+            body << "    if (budget <= " << block.count << ")\n    {\n";
+            if (pending > 0)
+                body << "        c.cycles += " << pending << ";\n";
+            body << "        c.pc = " << Hex(addr) << ";\n";
+            body << "        c.opcode = " << Hex(lastOpcode) << ";\n";
+            body << "        return;\n    }\n";
+        }
+
+        std::string x = "c.registers[" + Hex(in.x) + "]";
+        std::string y = "c.registers[" + Hex(in.y) + "]";
+        uint16_t next = addr + 2;
+
+        body << "    // " << Hex(addr) << ": " << Hex(in.opcode) << "\n";
+        pcSet = true;
+        opcodeSet = false;
+        ++pending;
+
+        // Jumps that may close an idle loop go through the handler, which
+        // detects them
+        bool idleJump = in.op == OP_1nnn && (in.nnn == addr || chip.IsTimerWait(in.nnn, addr));
+
+        switch (idleJump ? static_cast<uint8_t>(OP_COUNT) : in.op)
+        {
+        case OP_6xkk:
+            body << "    " << x << " = " << Hex(in.kk) << ";\n";
+            pcSet = false;
+            break;
+        case OP_7xkk:
+            body << "    " << x << " += " << Hex(in.kk) << ";\n";
+            pcSet = false;
+            break;
+        case OP_8xy0:
+            body << "    " << x << " = " << y << ";\n";
+            pcSet = false;
+            break;
+        case OP_8xy1:
+            body << "    " << x << " |= " << y << ";\n";
+            pcSet = false;
+            break;
+        case OP_8xy2:
+            body << "    " << x << " &= " << y << ";\n";
+            pcSet = false;
+            break;
+        case OP_8xy3:
+            body << "    " << x << " ^= " << y << ";\n";
+            pcSet = false;
+            break;
+        case OP_Annn:
+            body << "    c.IR = " << Hex(in.nnn) << ";\n";
+            pcSet = false;
+            break;
+        case OP_Fx07:
+            body << "    " << x << " = c.d_timer;\n";
+            pcSet = false;
+            break;
+        case OP_Fx15:
+            body << "    c.d_timer = " << x << ";\n";
+            pcSet = false;
+            break;
+        case OP_Fx1E:
+            body << "    c.IR += " << x << ";\n";
+            pcSet = false;
+            break;
+        case OP_1nnn:
+            body << "    c.pc = " << Hex(in.nnn) << ";\n";
+            todo.push_back(in.nnn);
+            break;
+        case OP_2nnn:
+            body << "    c.stack[c.sp & 0xF] = " << Hex(next) << ";\n";
+            body << "    ++c.sp;\n";
+            body << "    c.pc = " << Hex(in.nnn) << ";\n";
+            todo.push_back(in.nnn);
+            todo.push_back(next);
+            break;
+        case OP_00EE:
+            body << "    --c.sp;\n";
+            body << "    c.pc = c.stack[c.sp & 0xF];\n";
+            break;
+        case OP_3xkk:
+        case OP_4xkk:
+            body << "    c.pc = " << x << (in.op == OP_3xkk ? " == " : " != ") << Hex(in.kk)
+                 << " ? " << Hex(next + 2) << " : " << Hex(next) << ";\n";
+            todo.push_back(next);
+            todo.push_back(next + 2);
+            break;
+        case OP_5xy0:
+        case OP_9xy0:
+            body << "    c.pc = " << x << (in.op == OP_5xy0 ? " == " : " != ") << y
+                 << " ? " << Hex(next + 2) << " : " << Hex(next) << ";\n";
+            todo.push_back(next);
+            todo.push_back(next + 2);
+            break;
+        default:
+        {
+            // Everything else goes through the interpreter handler
+            std::string name = "I_" + Hex(addr).substr(2);
+            operands[addr] = "static const Instr " + name + " = {" + OP_ENUMS[in.op] + ", " +
+                             Hex(in.x) + ", " + Hex(in.y) + ", " + Hex(in.n) + ", " +
+                             Hex(in.kk) + ", " + Hex(in.nnn) + ", " + Hex(in.opcode) + "};\n";
+            body << "    c.cycles += " << pending << ";\n";
+            body << "    c.pc = " << Hex(next) << ";\n";
+            body << "    c.opcode = " << Hex(in.opcode) << ";\n";
+            pending = 0;
+            body << "    c." << OP_NAMES[in.op] << "(" << name << ");\n";
+
+            opcodeSet = true;
+
+            // Bnnn is a computed jump, left to the interpreter to follow.
+            // Skips on keys still fall through to one of two addresses.
+            if (in.op == OP_Ex9E || in.op == OP_ExA1)
+                todo.push_back(next + 2);
+            if (in.op == OP_1nnn)
+                todo.push_back(in.nnn);
+            else if (EndsBlock(in.op) && in.op != OP_Bnnn)
+                todo.push_back(next);
+            break;
+        }
+        }
+
+        lastOpcode = in.opcode;
+        addr = next;
+        ++block.count;
+
+        if (EndsBlock(in.op))
+            break;
+    }
+
+    if (block.count == 0)
+        return block;
+
+    if (pending > 0)
+        body << "    c.cycles += " << pending << ";\n";
+    if (!pcSet)
+    {
+        body << "    c.pc = " << Hex(addr) << ";\n";
+        // Straight-line code running into the block limit continues here
+        todo.push_back(addr);
+    }
+    if (!opcodeSet)
+        body << "    c.opcode = " << Hex(lastOpcode) << ";\n";
+
+    block.end = addr;
+    block.body = body.str();
+    block.resume = resume.str();
+    return block;
+}
+
+int main(int argc, char **argv)
+{
+    if (argc < 3)
+    {
+        std::cerr << "usage: chip8-aot rom.ch8 out.cpp [symbol]" << std::endl;
+        return 1;
+    }
+
+    const char *romPath = argv[1];
+    const char *outPath = argv[2];
+    std::string symbol = argc > 3 ? argv[3] : "CHIP8_AOT_PROGRAM";
+
+    std::ifstream file(romPath, std::ios::binary);
+    if (!file)
+    {
+        std::cerr << "Failed to open ROM: " << romPath << std::endl;
+        return 1;
+    }
+    std::vector<uint8_t> rom((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+
+    static Chip8 chip;
+    if (rom.size() > sizeof(chip.memory) - chip.START_ADRESS)
+    {
+        std::cerr << "ROM too large: " << rom.size() << " bytes" << std::endl;
+        return 1;
+    }
+    std::copy(rom.begin(), rom.end(), chip.memory + chip.START_ADRESS);
+    chip.Invalidate(chip.START_ADRESS, rom.size());
+
+    // Walk everything reachable from the entry point
+    std::vector<Block> blocks;
+    std::map<uint16_t, std::string> operands;
+    std::set<uint16_t> seen;
+    std::vector<uint16_t> todo{static_cast<uint16_t>(chip.START_ADRESS)};
+
+    while (!todo.empty())
+    {
+        uint16_t start = todo.back();
+        todo.pop_back();
+        if (!seen.insert(start).second)
+            continue;
+
+        Block block = Translate(chip, start, todo, operands);
+        if (block.count > 0)
+            blocks.push_back(block);
+    }
+
+    std::sort(blocks.begin(), blocks.end(), [](Block const &a, Block const &b)
+              { return a.start < b.start; });
+
+    std::ofstream out(outPath);
+    if (!out)
+    {
+        std::cerr << "Failed to write " << outPath << std::endl;
+        return 1;
+    }
+
+    out << "// Generated by chip8-aot from " << romPath << ". Do not edit.\n";
+    out << "#include \"aot.hpp\"\n\n";
+
+    out << "static const uint8_t ROM[] = {";
+    for (size_t i = 0; i < rom.size(); ++i)
+        out << (i % 16 == 0 ? "\n    " : " ") << Hex(rom[i]) << ",";
+    out << "\n};\n\n";
+
+    for (auto const &entry : operands)
+        out << entry.second;
+    out << "\n";
+
+    for (Block const &block : blocks)
+    {
+        out << "static void B_" << Hex(block.start).substr(2) << "(Chip8 &c, int budget)\n{\n";
+        if (!block.resume.empty())
+            out << "    switch (c.pc)\n    {\n" << block.resume << "    }\n";
+        out << block.body;
+        out << "}\n\n";
+    }
+
+    out << "static const AotBlock BLOCKS[] = {\n";
+    for (Block const &block : blocks)
+    {
+        out << "    {" << Hex(block.start) << ", " << Hex(block.end) << ", " << block.count
+            << ", B_" << Hex(block.start).substr(2) << "},\n";
+    }
+    out << "};\n\n";
+
+    out << "extern const AotProgram " << symbol << ";\n";
+    out << "const AotProgram " << symbol << " = {ROM, sizeof(ROM), BLOCKS, "
+        << blocks.size() << "};\n";
+
+    std::cout << "chip8-aot: " << blocks.size() << " blocks from " << romPath << std::endl;
+    return 0;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include "chip8.hpp"
+
+// Interface between Chip8 and translation units generated by chip8-aot.
+//
+// A generated file holds one function per basic block of the ROM it was
+// made from. Each function runs its block on a Chip8 from c.pc, which may be
+// any instruction in [start, end), stops early after `budget` instructions
+// and leaves pc, opcode and cycles exactly as the interpreter would.
+
+struct AotBlock
+{
+    uint16_t start;
+    uint16_t end; // one past the last byte
+    uint16_t count;
+    void (*fn)(Chip8 &, int budget);
+};
+
+struct AotProgram
+{
+    // ROM image the blocks were translated from, loaded at 0x200
+    uint8_t const *rom;
+    size_t romSize;
+
+    AotBlock const *blocks;
+    size_t blockCount;
+};
@@ -0,0 +1,70 @@
+#include "audio.hpp"
+#include <algorithm>
+#include <cmath>
+
+// Samples an on/off edge takes to reach full or zero gain
+static constexpr float RAMP_SAMPLES = 64.0f;
+static constexpr float AMPLITUDE = 0.25f * 32767.0f;
+
+ToneStream::ToneStream(EmulatorThread &emulator, unsigned sampleRate, unsigned bufferSamples, double frequency)
+    : emulator(emulator), buffer(bufferSamples), sampleRate(sampleRate), phaseStep(frequency / sampleRate)
+{
+    initialize(1, sampleRate, {sf::SoundChannel::Mono});
+}
+
+int64_t ToneStream::SampleAt(double time) const
+{
+    return static_cast<int64_t>(std::llround(time * sampleRate + offset));
+}
+
+bool ToneStream::onGetData(Chunk &data)
+{
+    int64_t const latency = static_cast<int64_t>(LATENCY * sampleRate);
+
+    for (size_t i = 0; i < buffer.size(); ++i, ++sampleClock)
+    {
+        if (!hasNext)
+            hasNext = emulator.TakeSoundEvent(next);
+
+        while (hasNext)
+        {
+            // Re-anchor the two clocks on the first edge, and whenever an
+            // edge lands in the past or implausibly far ahead (emulation
+            // stalled, was capped, or a ROM was loaded)
+            int64_t at = SampleAt(next.time);
+            if (!anchored || at < sampleClock - latency || at > sampleClock + 4 * latency)
+            {
+                offset = static_cast<double>(sampleClock + latency) - next.time * sampleRate;
+                anchored = true;
+                at = sampleClock + latency;
+            }
+
+            if (at > sampleClock)
+                break;
+
+            target = next.on ? 1.0f : 0.0f;
+            hasNext = emulator.TakeSoundEvent(next);
+        }
+
+        if (level < target)
+            level = std::min(target, level + 1.0f / RAMP_SAMPLES);
+        else if (level > target)
+            level = std::max(target, level - 1.0f / RAMP_SAMPLES);
+
+        float wave = phase < 0.5 ? 1.0f : -1.0f;
+        buffer[i] = static_cast<int16_t>(wave * level * AMPLITUDE);
+
+        phase += phaseStep;
+        if (phase >= 1.0)
+            phase -= 1.0;
+    }
+
+    data.samples = buffer.data();
+    data.sampleCount = buffer.size();
+    return true;
+}
+
+void ToneStream::onSeek(sf::Time)
+{
+    // A generated stream has no position to seek to
+}
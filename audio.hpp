@@ -0,0 +1,45 @@
+#pragma once
+
+#include <SFML/Audio.hpp>
+#include <cstdint>
+#include <vector>
+#include "emulator_thread.hpp"
+
+// Square-wave beeper driven by the sound timer. Tone on/off edges come
+// from the emulation thread stamped in emulated time and are placed at
+// the matching sample, a fixed delay behind emulation. Edges ramp over a
+// few samples and the oscillator phase runs continuously, so there are no
+// clicks.
+class ToneStream : public sf::SoundStream
+{
+public:
+    // bufferSamples is the chunk handed to the device per onGetData
+    ToneStream(EmulatorThread &emulator, unsigned sampleRate = 44100, unsigned bufferSamples = 256,
+               double frequency = 440.0);
+
+    // Emulated time is played this far behind; covers one emulation slice
+    // plus scheduling jitter
+    static constexpr double LATENCY = 0.008;
+
+private:
+    bool onGetData(Chunk &data) override;
+    void onSeek(sf::Time timeOffset) override;
+
+    // Sample index at which emulated time `time` plays
+    int64_t SampleAt(double time) const;
+
+    EmulatorThread &emulator;
+    std::vector<int16_t> buffer;
+    unsigned sampleRate;
+    double phaseStep;
+    double phase = 0.0;
+    float level = 0.0f; // current gain, ramps towards target
+    float target = 0.0f;
+
+    int64_t sampleClock = 0; // samples generated so far
+    double offset = 0.0;     // SampleAt(t) = t * sampleRate + offset
+    bool anchored = false;
+
+    SoundEvent next;
+    bool hasNext = false;
+};
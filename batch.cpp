@@ -0,0 +1,201 @@
+#include "batch.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include "thread_pool.hpp"
+
+namespace
+{
+    struct JobOutcome
+    {
+        bool ok = false;
+        std::string error;
+        RunResult result;
+    };
+
+    std::string JsonString(std::string const &s)
+    {
+        std::string out = "\"";
+        for (char c : s)
+        {
+            if (c == '"' || c == '\\')
+                out += '\\';
+            if (static_cast<unsigned char>(c) < 0x20)
+            {
+                char buf[8];
+                snprintf(buf, sizeof(buf), "\\u%04x", c);
+                out += buf;
+                continue;
+            }
+            out += c;
+        }
+        return out + "\"";
+    }
+
+    std::vector<JobOutcome> RunAll(std::vector<RunOptions> const &jobs, unsigned threads)
+    {
+        std::vector<JobOutcome> outcomes(jobs.size());
+        ThreadPool pool(threads);
+
+        for (size_t i = 0; i < jobs.size(); ++i)
+        {
+            pool.Submit([&jobs, &outcomes, i]
+                        {
+                            // Each job gets its own machine
+                            auto chip = std::make_unique<Chip8>();
+                            JobOutcome &outcome = outcomes[i];
+                            outcome.ok = RunRom(jobs[i], *chip, outcome.result, outcome.error); });
+        }
+        pool.Wait();
+        return outcomes;
+    }
+}
+
+bool LoadManifest(char const *path, RunOptions const &defaults, std::vector<RunOptions> &jobs, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = std::string("cannot open manifest ") + path;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        std::istringstream in(line);
+        RunOptions job = defaults;
+        std::string input;
+
+        if (!(in >> job.rom) || job.rom[0] == '#')
+            continue;
+
+        if (in >> input && input != "-")
+        {
+            job.input.clear();
+            if (!LoadInputScript(input.c_str(), job.input, error))
+            {
+                error = std::string(path) + ":" + std::to_string(lineNumber) + ": " + error;
+                return false;
+            }
+        }
+        uint32_t frames;
+        if (in >> frames)
+            job.frames = frames;
+        jobs.push_back(job);
+    }
+    return true;
+}
+
+bool RunBatch(std::vector<RunOptions> const &jobs, unsigned threads, std::ostream &out)
+{
+    std::vector<JobOutcome> outcomes = RunAll(jobs, threads);
+    bool allOk = true;
+
+    for (size_t i = 0; i < jobs.size(); ++i)
+    {
+        JobOutcome const &outcome = outcomes[i];
+        RunResult const &r = outcome.result;
+
+        out << "{\"job\":" << i << ",\"rom\":" << JsonString(jobs[i].rom);
+        if (!outcome.ok)
+        {
+            out << ",\"error\":" << JsonString(outcome.error) << "}\n";
+            allOk = false;
+            continue;
+        }
+
+        char hash[17];
+        snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(r.hash));
+
+        out << ",\"frames\":" << jobs[i].frames
+            << ",\"instructions\":" << r.instructions
+            << ",\"seconds\":" << r.seconds
+            << ",\"fps\":" << (r.seconds > 0 ? jobs[i].frames / r.seconds : 0.0)
+            << ",\"hash\":\"" << hash << "\""
+            << ",\"faults\":{";
+        for (int k = 1; k < static_cast<int>(TraceKind::COUNT); ++k)
+        {
+            out << (k > 1 ? "," : "") << "\"" << TraceKindName(static_cast<TraceKind>(k)) << "\":" << r.faults[k];
+        }
+        out << "}}\n";
+    }
+    return allOk;
+}
+
+void RunScaling(std::vector<RunOptions> const &jobs, unsigned maxThreads, std::ostream &out)
+{
+    double baseline = 0.0;
+
+    for (unsigned threads = 1; threads <= maxThreads; ++threads)
+    {
+        auto start = std::chrono::steady_clock::now();
+        RunAll(jobs, threads);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        if (threads == 1)
+            baseline = seconds;
+
+        out << "{\"threads\":" << threads
+            << ",\"seconds\":" << seconds
+            << ",\"jobs_per_second\":" << (seconds > 0 ? jobs.size() / seconds : 0.0)
+            << ",\"speedup\":" << (seconds > 0 ? baseline / seconds : 0.0) << "}\n";
+    }
+}
+
+bool VerifyMovie(RunOptions const &options, Movie const &movie, unsigned threads, std::ostream &out)
+{
+    std::string error;
+    {
+        auto chip = std::make_unique<Chip8>();
+        if (!StartMovie(movie, options.rom.c_str(), *chip, error) || !SelectCore(options, *chip, error))
+        {
+            out << "{\"rom\":" << JsonString(options.rom) << ",\"error\":" << JsonString(error) << "}\n";
+            return false;
+        }
+    }
+
+    size_t segments = movie.Segments();
+    std::vector<uint8_t> matched(segments, 0);
+
+    auto start = std::chrono::steady_clock::now();
+    {
+        ThreadPool pool(threads);
+        for (size_t i = 0; i < segments; ++i)
+        {
+            pool.Submit([&options, &movie, &matched, i]
+                        {
+                            // Each segment gets its own machine
+                            auto chip = std::make_unique<Chip8>();
+                            std::string error;
+                            matched[i] = StartMovie(movie, options.rom.c_str(), *chip, error) &&
+                                         SelectCore(options, *chip, error) &&
+                                         ReplaySegment(movie, i, *chip); });
+        }
+        pool.Wait();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    size_t first = std::find(matched.begin(), matched.end(), 0) - matched.begin();
+
+    out << "{\"rom\":" << JsonString(options.rom)
+        << ",\"segments\":" << segments
+        << ",\"instructions\":" << movie.cycles
+        << ",\"threads\":" << threads
+        << ",\"seconds\":" << seconds
+        << ",\"ok\":" << (first == segments ? "true" : "false");
+    if (first < segments)
+    {
+        out << ",\"first_diverging\":" << first
+            << ",\"start_cycle\":" << movie.SegmentStart(first)
+            << ",\"end_cycle\":" << movie.SegmentEnd(first)
+            << ",\"diverging\":" << std::count(matched.begin(), matched.end(), 0);
+    }
+    out << "}\n";
+    return first == segments;
+}
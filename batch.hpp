@@ -0,0 +1,27 @@
+#pragma once
+
+#include <ostream>
+#include <string>
+#include <vector>
+#include "runner.hpp"
+
+// Batch mode of chip8-headless: many ROM runs spread over a thread pool.
+//
+// A manifest has one job per line, `rom [input-script|-] [frames]`;
+// blank lines and lines starting with # are skipped. Missing fields take
+// the values from `defaults` (the command line options).
+bool LoadManifest(char const *path, RunOptions const &defaults, std::vector<RunOptions> &jobs, std::string &error);
+
+// Run every job on `threads` workers and write one JSON object per job, in
+// manifest order. Returns false if any job failed.
+bool RunBatch(std::vector<RunOptions> const &jobs, unsigned threads, std::ostream &out);
+
+// Run the whole manifest with 1..maxThreads workers and write one JSON
+// object per thread count with the wall time and speedup over 1 thread.
+void RunScaling(std::vector<RunOptions> const &jobs, unsigned maxThreads, std::ostream &out);
+
+// Replay every segment of a movie of options.rom (see Movie::Segments) on
+// `threads` workers, each from its keyframe, and write one JSON object with
+// the outcome and the first segment whose end state differs from the
+// recording. Returns false if a segment diverged or the ROM is wrong.
+bool VerifyMovie(RunOptions const &options, Movie const &movie, unsigned threads, std::ostream &out);
@@ -0,0 +1,532 @@
+// chip8-bench: nanoseconds per instruction for every handler and for the
+// full Cycle dispatch, to put numbers on changes to the core.
+//
+//   chip8-bench [--filter TEXT] [--json FILE] [--baseline FILE] [--threshold PCT]
+//
+// Handlers are timed one opcode at a time through Chip8::Execute, with
+// Dxyn at several heights and wrap positions and Fx55/Fx65 at every x.
+// Cycle is timed on synthetic programs (ALU, branches, memory, drawing
+// and a mix) on every interpreter core, and so are whole 60 Hz frames run
+// by the Scheduler at the default 700 instructions per second. Each
+// benchmark runs a number of samples; the median and the 5th/95th
+// percentiles are reported.
+//
+// --aot FILE (chip8-aot output built as a shared library) adds
+// Frames/<core>/rom for every core, the Aot core included, on the ROM
+// embedded in that program.
+//
+// --json writes one JSON object per benchmark and line. --baseline reads
+// such a file back and fails (exit 1) if any median got slower by more
+// than --threshold percent (default 10).
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+#include "runner.hpp"
+#include "scheduler.hpp"
+
+struct Options
+{
+    std::string filter;
+    uint32_t samples = 31;
+    uint32_t iterations = 100000; // handler calls per sample
+    uint32_t cycles = 5000;       // Cycle calls per sample (12 slots each)
+    uint32_t frames = 3000;       // Scheduler frames per sample
+    AotProgram const *aot = nullptr;
+};
+
+struct Result
+{
+    std::string name;
+    double median; // ns per instruction
+    double p5;
+    double p95;
+};
+
+// Sample percentile q in [0, 1] of sorted values
+static double Percentile(std::vector<double> const &sorted, double q)
+{
+    return sorted[static_cast<size_t>(q * (sorted.size() - 1) + 0.5)];
+}
+
+// Run `sample` (which returns ns per instruction) once to warm up, then
+// options.samples times
+template <typename Sample>
+static Result Measure(std::string const &name, Options const &options, Sample sample)
+{
+    sample();
+
+    std::vector<double> values;
+    for (uint32_t i = 0; i < options.samples; ++i)
+        values.push_back(sample());
+    std::sort(values.begin(), values.end());
+
+    return {name, Percentile(values, 0.5), Percentile(values, 0.05), Percentile(values, 0.95)};
+}
+
+static double Nanoseconds(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+}
+
+// A machine with a ROM-free, predictable state: registers 1..15, I in free
+// memory, screen clear
+static std::unique_ptr<Chip8> MakeChip()
+{
+    auto chip = std::make_unique<Chip8>();
+    for (uint8_t r = 0; r < 16; ++r)
+        chip->registers[r] = r;
+    chip->IR = 0x300;
+    return chip;
+}
+
+// Decoded form of one opcode, the way the cores see it
+static Instr DecodeAt(Chip8 &chip, uint16_t opcode)
+{
+    const uint16_t ADDR = 0xE00;
+    chip.memory[ADDR] = static_cast<uint8_t>(opcode >> 8);
+    chip.memory[ADDR + 1] = static_cast<uint8_t>(opcode);
+    chip.Invalidate(ADDR, 2);
+    chip.Decode(ADDR);
+    return chip.decoded[ADDR];
+}
+
+// Time one handler. `setup` runs before each sample, `fixup` before every
+// call for handlers that would otherwise run off the end of something
+// (the stack, memory).
+template <typename Setup, typename Fixup>
+static Result BenchOpcode(std::string const &name, uint16_t opcode, Options const &options, Setup setup, Fixup fixup)
+{
+    auto chip = MakeChip();
+    Instr in = DecodeAt(*chip, opcode);
+
+    return Measure(name, options, [&]
+                   {
+                       setup(*chip);
+                       chip->pc = 0x200;
+                       auto start = std::chrono::steady_clock::now();
+                       for (uint32_t i = 0; i < options.iterations; ++i)
+                       {
+                           fixup(*chip);
+                           chip->Execute(in);
+                       }
+                       return Nanoseconds(start) / options.iterations; });
+}
+
+static Result BenchOpcode(std::string const &name, uint16_t opcode, Options const &options)
+{
+    return BenchOpcode(name, opcode, options, [](Chip8 &) {}, [](Chip8 &) {});
+}
+
+// Synthetic programs for the Cycle benchmarks: a loop body ending in a jump
+// back to 0x200
+static std::vector<uint16_t> Program(std::string const &mix)
+{
+    std::vector<uint16_t> ops;
+
+    auto alu = [&ops](int i)
+    {
+        uint16_t x = static_cast<uint16_t>(i % 14);
+        uint16_t y = static_cast<uint16_t>((i + 5) % 14);
+        static const uint16_t ALU[] = {0x8000, 0x8001, 0x8002, 0x8003, 0x8004, 0x8005, 0x8006, 0x8007, 0x800E};
+        ops.push_back(static_cast<uint16_t>(0x6000 | x << 8 | (i * 37 & 0xFF)));
+        ops.push_back(static_cast<uint16_t>(0x7000 | y << 8 | (i * 11 & 0xFF)));
+        ops.push_back(static_cast<uint16_t>(ALU[i % 9] | x << 8 | y << 4));
+    };
+    auto branch = [&ops](int i)
+    {
+        uint16_t x = static_cast<uint16_t>(i % 14);
+        static const uint16_t SKIP[] = {0x3000, 0x4000, 0x5000, 0x9000};
+        uint16_t skip = SKIP[i % 4];
+        ops.push_back(static_cast<uint16_t>(skip | x << 8 | (skip >= 0x5000 ? ((i + 1) % 14) << 4 : i & 0xFF)));
+        ops.push_back(static_cast<uint16_t>(0x7000 | x << 8 | 1));
+    };
+    auto memory = [&ops](int i)
+    {
+        uint16_t x = static_cast<uint16_t>(i % 14);
+        ops.push_back(static_cast<uint16_t>(0xA800 | (i * 16 & 0xFF)));
+        ops.push_back(static_cast<uint16_t>(0xF033 | x << 8));
+        ops.push_back(static_cast<uint16_t>(0xF055 | x << 8));
+        ops.push_back(static_cast<uint16_t>(0xF065 | x << 8));
+        ops.push_back(static_cast<uint16_t>(0xF029 | x << 8));
+        ops.push_back(static_cast<uint16_t>(0xF01E | x << 8));
+    };
+    auto draw = [&ops](int i)
+    {
+        uint16_t x = static_cast<uint16_t>(i % 14);
+        ops.push_back(static_cast<uint16_t>(0xF029 | x << 8));
+        ops.push_back(static_cast<uint16_t>(0x6000 | x << 8 | (i * 13 & 0x3F)));
+        ops.push_back(static_cast<uint16_t>(0xD005 | x << 8 | ((i + 1) % 14) << 4));
+        if (i % 16 == 15)
+            ops.push_back(0x00E0);
+    };
+
+    if (mix == "alu")
+        for (int i = 0; i < 64; ++i)
+            alu(i);
+    else if (mix == "branch")
+        for (int i = 0; i < 64; ++i)
+            branch(i);
+    else if (mix == "memory")
+        for (int i = 0; i < 32; ++i)
+            memory(i);
+    else if (mix == "draw")
+        for (int i = 0; i < 48; ++i)
+            draw(i);
+    else
+    {
+        // Roughly what games run: mostly ALU and branches, some memory
+        // and drawing
+        std::mt19937 random(1);
+        for (int i = 0; i < 64; ++i)
+        {
+            unsigned pick = random() % 10;
+            if (pick < 4)
+                alu(i);
+            else if (pick < 7)
+                branch(i);
+            else if (pick < 9)
+                memory(i);
+            else
+                draw(i);
+        }
+    }
+
+    ops.push_back(0x1200);
+    return ops;
+}
+
+// A machine running Program(mix) on core
+static std::unique_ptr<Chip8> MakeProgramChip(Core core, std::string const &mix)
+{
+    auto chip = MakeChip();
+    std::vector<uint16_t> program = Program(mix);
+    for (size_t i = 0; i < program.size(); ++i)
+    {
+        chip->memory[0x200 + 2 * i] = static_cast<uint8_t>(program[i] >> 8);
+        chip->memory[0x200 + 2 * i + 1] = static_cast<uint8_t>(program[i]);
+    }
+    chip->Invalidate(0x200, static_cast<uint32_t>(2 * program.size()));
+    chip->core = core;
+    return chip;
+}
+
+// A machine that has loaded the ROM embedded in program
+static std::unique_ptr<Chip8> MakeRomChip(Core core, AotProgram const &program)
+{
+    auto chip = std::make_unique<Chip8>();
+    std::copy(program.rom, program.rom + program.romSize, chip->memory + chip->START_ADRESS);
+    chip->Invalidate(chip->START_ADRESS, static_cast<uint32_t>(program.romSize));
+    chip->core = core;
+    if (core == Core::Aot)
+        chip->AttachAot(&program);
+    return chip;
+}
+
+static Result BenchCycle(std::string const &name, Core core, std::string const &mix, Options const &options)
+{
+    auto chip = MakeProgramChip(core, mix);
+
+    return Measure(name, options, [&]
+                   {
+                       uint64_t before = chip->cycles;
+                       auto start = std::chrono::steady_clock::now();
+                       for (uint32_t i = 0; i < options.cycles; ++i)
+                           chip->Cycle();
+                       return Nanoseconds(start) / static_cast<double>(chip->cycles - before); });
+}
+
+// Same programs in the spans the frontends run: the Scheduler at the
+// default speed, about 12 instructions between timer ticks
+static Result BenchFrames(std::string const &name, std::unique_ptr<Chip8> chip, Options const &options)
+{
+    Scheduler scheduler(*chip);
+
+    return Measure(name, options, [&]
+                   {
+                       uint64_t before = chip->cycles;
+                       auto start = std::chrono::steady_clock::now();
+                       scheduler.RunFrames(options.frames);
+                       return Nanoseconds(start) / static_cast<double>(chip->cycles - before); });
+}
+
+// Every benchmark whose name contains options.filter
+static std::vector<Result> RunAll(Options const &options)
+{
+    std::vector<Result> results;
+    auto want = [&options](std::string const &name)
+    {
+        return name.find(options.filter) != std::string::npos;
+    };
+    auto add = [&](std::string const &name, auto bench)
+    {
+        if (want(name))
+        {
+            results.push_back(bench(name));
+            std::fprintf(stderr, "%-28s %8.2f ns\n", name.c_str(), results.back().median);
+        }
+    };
+    auto opcode = [&](std::string const &name, uint16_t op)
+    {
+        add(name, [&](std::string const &n)
+            { return BenchOpcode(n, op, options); });
+    };
+
+    auto noop = [](Chip8 &) {};
+    add("OPNULL", [&](std::string const &n)
+        { return BenchOpcode(n, 0x0123, options); });
+    opcode("OP00E0", 0x00E0);
+    add("OP00EE", [&](std::string const &n)
+        { return BenchOpcode(n, 0x00EE, options, noop, [](Chip8 &c)
+                             { c.sp = 1; }); });
+    opcode("OP1nnn", 0x1400);
+    add("OP2nnn", [&](std::string const &n)
+        { return BenchOpcode(n, 0x2400, options, noop, [](Chip8 &c)
+                             { c.sp = 0; }); });
+    opcode("OP3xkk", 0x3305);
+    opcode("OP4xkk", 0x4305);
+    opcode("OP5xy0", 0x5340);
+    opcode("OP6xkk", 0x6342);
+    opcode("OP7xkk", 0x7342);
+    opcode("OP8xy0", 0x8340);
+    opcode("OP8xy1", 0x8341);
+    opcode("OP8xy2", 0x8342);
+    opcode("OP8xy3", 0x8343);
+    opcode("OP8xy4", 0x8344);
+    opcode("OP8xy5", 0x8345);
+    opcode("OP8xy6", 0x8346);
+    opcode("OP8xy7", 0x8347);
+    opcode("OP8xyE", 0x834E);
+    opcode("OP9xy0", 0x9340);
+    opcode("OPAnnn", 0xA400);
+    opcode("OPBnnn", 0xB400);
+    opcode("OPCxkk", 0xC3FF);
+    opcode("OPEx9E", 0xE39E);
+    opcode("OPExA1", 0xE3A1);
+    opcode("OPFx07", 0xF307);
+    opcode("OPFx0A", 0xF30A);
+    opcode("OPFx15", 0xF315);
+    opcode("OPFx18", 0xF018); // V0 = 0: the tone stays off
+    add("OPFx1E", [&](std::string const &n)
+        { return BenchOpcode(n, 0xF31E, options, noop, [](Chip8 &c)
+                             { c.IR = 0x300; }); });
+    opcode("OPFx29", 0xF329);
+    opcode("OPFx33", 0xF333);
+
+    for (uint16_t x = 0; x < 16; ++x)
+    {
+        opcode("OPFx55/x" + std::to_string(x), static_cast<uint16_t>(0xF055 | x << 8));
+        opcode("OPFx65/x" + std::to_string(x), static_cast<uint16_t>(0xF065 | x << 8));
+    }
+
+    // Dxyn: V1, V2 hold the position; wrapping sprites cross an edge
+    struct Position
+    {
+        char const *name;
+        uint8_t x;
+        uint8_t y;
+    };
+    static const Position POSITIONS[] = {{"inside", 8, 4}, {"wrap-x", 60, 4}, {"wrap-y", 8, 28}, {"wrap-xy", 60, 28}};
+    for (uint8_t height : {1, 5, 8, 15})
+    {
+        for (Position const &at : POSITIONS)
+        {
+            for (bool clip : {false, true})
+            {
+                std::string name = "OPDxyn/h" + std::to_string(height) + "/" + at.name + (clip ? "/clip" : "");
+                uint8_t x = at.x;
+                uint8_t y = at.y;
+                add(name, [&](std::string const &n)
+                    { return BenchOpcode(
+                          n, static_cast<uint16_t>(0xD120 | height), options,
+                          [x, y, clip](Chip8 &c)
+                          {
+                              c.registers[1] = x;
+                              c.registers[2] = y;
+                              c.IR = 0x300;
+                              c.clipSprites = clip;
+                              std::fill(c.memory + 0x300, c.memory + 0x310, 0xA5);
+                          },
+                          noop); });
+            }
+        }
+    }
+
+    static const std::pair<char const *, Core> CORES[] = {
+        {"table", Core::Table}, {"threaded", Core::Threaded}, {"jit", Core::Jit}};
+    for (auto const &core : CORES)
+    {
+        for (char const *mix : {"alu", "branch", "memory", "draw", "mixed"})
+        {
+            add(std::string("Cycle/") + core.first + "/" + mix, [&](std::string const &n)
+                { return BenchCycle(n, core.second, mix, options); });
+        }
+    }
+    for (auto const &core : CORES)
+    {
+        for (char const *mix : {"alu", "mixed"})
+        {
+            add(std::string("Frames/") + core.first + "/" + mix, [&](std::string const &n)
+                { return BenchFrames(n, MakeProgramChip(core.second, mix), options); });
+        }
+    }
+
+    if (options.aot)
+    {
+        static const std::pair<char const *, Core> ROM_CORES[] = {
+            {"table", Core::Table}, {"threaded", Core::Threaded}, {"jit", Core::Jit}, {"aot", Core::Aot}};
+        for (auto const &core : ROM_CORES)
+        {
+            add(std::string("Frames/") + core.first + "/rom", [&](std::string const &n)
+                { return BenchFrames(n, MakeRomChip(core.second, *options.aot), options); });
+        }
+    }
+
+    return results;
+}
+
+static void WriteJson(std::ostream &out, std::vector<Result> const &results)
+{
+    for (Result const &r : results)
+    {
+        out << "{\"name\":\"" << r.name << "\""
+            << ",\"median_ns\":" << r.median
+            << ",\"p5_ns\":" << r.p5
+            << ",\"p95_ns\":" << r.p95 << "}\n";
+    }
+}
+
+// Medians by name from a file written by WriteJson
+static bool ReadBaseline(char const *path, std::map<std::string, double> &medians)
+{
+    std::ifstream in(path);
+    if (!in)
+        return false;
+
+    std::string line;
+    while (std::getline(in, line))
+    {
+        size_t name = line.find("\"name\":\"");
+        size_t median = line.find("\"median_ns\":");
+        if (name == std::string::npos || median == std::string::npos)
+            continue;
+        name += 8;
+        medians[line.substr(name, line.find('"', name) - name)] = std::strtod(line.c_str() + median + 12, nullptr);
+    }
+    return true;
+}
+
+static void Usage()
+{
+    std::cerr << "usage: chip8-bench [options]\n"
+                 "  --filter TEXT     only benchmarks whose name contains TEXT\n"
+                 "  --samples N       samples per benchmark (default 31)\n"
+                 "  --json FILE       write results as JSON lines (- for stdout)\n"
+                 "  --baseline FILE   compare medians against an earlier --json file\n"
+                 "  --threshold PCT   slowdown that fails the comparison (default 10)\n"
+                 "  --aot FILE        also time every core on the ROM of this chip8-aot\n"
+                 "                    output, built as a shared library\n";
+}
+
+int main(int argc, char **argv)
+{
+    Options options;
+    char const *jsonPath = nullptr;
+    char const *baselinePath = nullptr;
+    double threshold = 10.0;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--filter" && hasValue)
+            options.filter = argv[++i];
+        else if (arg == "--samples" && hasValue)
+            options.samples = static_cast<uint32_t>(std::max(1ul, std::strtoul(argv[++i], nullptr, 10)));
+        else if (arg == "--json" && hasValue)
+            jsonPath = argv[++i];
+        else if (arg == "--baseline" && hasValue)
+            baselinePath = argv[++i];
+        else if (arg == "--threshold" && hasValue)
+            threshold = std::strtod(argv[++i], nullptr);
+        else if (arg == "--aot" && hasValue)
+        {
+            std::string error;
+            if (!LoadAotProgram(argv[++i], options.aot, error))
+            {
+                std::cerr << error << std::endl;
+                return 2;
+            }
+        }
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    std::map<std::string, double> baseline;
+    if (baselinePath && !ReadBaseline(baselinePath, baseline))
+    {
+        std::cerr << "cannot read baseline " << baselinePath << std::endl;
+        return 2;
+    }
+
+    if (!Chip8::OPTIMIZED)
+        std::cerr << "warning: the core was built without optimization, timings do not reflect a release build"
+                  << std::endl;
+
+    std::vector<Result> results = RunAll(options);
+
+    if (jsonPath)
+    {
+        if (std::string(jsonPath) == "-")
+            WriteJson(std::cout, results);
+        else
+        {
+            std::ofstream out(jsonPath);
+            WriteJson(out, results);
+            if (!out)
+            {
+                std::cerr << "cannot write " << jsonPath << std::endl;
+                return 2;
+            }
+        }
+    }
+    else
+    {
+        std::printf("%-28s %10s %10s %10s\n", "benchmark", "median ns", "p5 ns", "p95 ns");
+        for (Result const &r : results)
+            std::printf("%-28s %10.2f %10.2f %10.2f\n", r.name.c_str(), r.median, r.p5, r.p95);
+    }
+
+    int regressions = 0;
+    for (Result const &r : results)
+    {
+        auto base = baseline.find(r.name);
+        if (base == baseline.end() || base->second <= 0)
+            continue;
+
+        double change = (r.median / base->second - 1.0) * 100.0;
+        if (change > threshold)
+        {
+            std::fprintf(stderr, "regression: %s %.2f -> %.2f ns (+%.1f%%)\n", r.name.c_str(), base->second, r.median,
+                         change);
+            ++regressions;
+        }
+    }
+    if (baselinePath)
+        std::fprintf(stderr, "%d of %zu benchmarks slower than baseline by more than %.1f%%\n", regressions,
+                     results.size(), threshold);
+
+    return regressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,308 @@
+// chip8-bisect: find the first instruction where two configurations of the
+// emulator disagree.
+//
+//   chip8-bisect rom.ch8 --a table --b jit [--movie run.c8mv]
+//   chip8-bisect rom.ch8 --a table --b table+clip --input keys.txt --frames 3600
+//   chip8-bisect rom.ch8 --a table --b aot --aot rom_aot.so --movie run.c8mv
+//
+// Both sides replay the same movie (or an input script, recorded into one
+// on side A). State hashes are compared at checkpoints 1, 2, 4, 8, ...
+// instructions past the last agreement; once a checkpoint differs, the gap
+// is halved from the last agreeing snapshot until it is one instruction
+// wide. That is O(log n) comparisons instead of comparing after every
+// instruction. The report names the instruction and diffs the full state.
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "movie.hpp"
+#include "runner.hpp"
+#include "scheduler.hpp"
+
+// Core plus quirks of one side, written `core[+clip]`
+struct Config
+{
+    Core core = Core::Table;
+    bool clipSprites = false;
+    std::string name = "table";
+};
+
+static bool ParseConfig(std::string const &text, Config &config)
+{
+    config.name = text;
+    size_t plus = text.find('+');
+    if (!ParseCore(text.substr(0, plus), config.core))
+        return false;
+
+    while (plus != std::string::npos)
+    {
+        size_t next = text.find('+', plus + 1);
+        std::string quirk = text.substr(plus + 1, next == std::string::npos ? next : next - plus - 1);
+        if (quirk == "clip")
+            config.clipSprites = true;
+        else if (quirk == "wrap")
+            config.clipSprites = false;
+        else
+            return false;
+        plus = next;
+    }
+    return true;
+}
+
+// One side of the comparison
+struct Side
+{
+    Config config;
+    std::unique_ptr<Chip8> chip = std::make_unique<Chip8>();
+    Snapshot agreed; // state at the last cycle both sides agreed on
+};
+
+// Run chip to exactly `target`, applying the movie's key edges on the way
+static void RunTo(Chip8 &chip, Movie const &movie, uint64_t target)
+{
+    Scheduler scheduler(chip);
+    for (KeyEdge const &edge : movie.edges)
+        if (edge.cycle >= chip.cycles && edge.cycle < target)
+            scheduler.QueueKey(edge);
+    scheduler.RunUntil(target);
+}
+
+static void Usage()
+{
+    std::cerr << "usage: chip8-bisect ROM --a CONFIG --b CONFIG [options]\n"
+                 "  CONFIG          core[+clip|+wrap], core is table, threaded, jit or aot\n"
+                 "  --aot FILE      chip8-aot output built as a shared library\n"
+                 "  --movie FILE    replay this movie on both sides\n"
+                 "  --input FILE    or: input script, lines of `frame key down|up`\n"
+                 "  --frames N      60 Hz frames to run without a movie (default 600)\n"
+                 "  --ips N         instructions per second without a movie (default 700)\n"
+                 "  --seed N        random number seed without a movie (default 0)\n";
+}
+
+static void PrintDiff(char const *name, unsigned a, unsigned b, int width)
+{
+    if (a != b)
+        std::printf("  %-10s %0*X  %0*X\n", name, width, a, width, b);
+}
+
+// Every field of the machine state that differs, A then B
+static void PrintStateDiff(Chip8 const &a, Chip8 const &b)
+{
+    char name[32];
+
+    PrintDiff("PC", a.pc, b.pc, 3);
+    PrintDiff("I", a.IR, b.IR, 3);
+    PrintDiff("SP", a.sp, b.sp, 1);
+    for (int r = 0; r < 16; ++r)
+    {
+        std::snprintf(name, sizeof(name), "V%X", r);
+        PrintDiff(name, a.registers[r], b.registers[r], 2);
+    }
+    for (int i = 0; i < 16; ++i)
+    {
+        std::snprintf(name, sizeof(name), "stack[%d]", i);
+        PrintDiff(name, a.stack[i], b.stack[i], 3);
+    }
+    PrintDiff("DT", a.d_timer, b.d_timer, 2);
+    PrintDiff("ST", a.s_timer, b.s_timer, 2);
+    PrintDiff("waitKey", static_cast<uint8_t>(a.waitKey), static_cast<uint8_t>(b.waitKey), 2);
+    for (int k = 0; k < 16; ++k)
+    {
+        std::snprintf(name, sizeof(name), "key %X", k);
+        PrintDiff(name, a.keypad[k], b.keypad[k], 1);
+    }
+    if (a.randGen.state != b.randGen.state)
+        std::printf("  %-10s %016llX  %016llX\n", "rng", static_cast<unsigned long long>(a.randGen.state),
+                    static_cast<unsigned long long>(b.randGen.state));
+
+    for (unsigned addr = 0; addr < sizeof(a.memory); ++addr)
+    {
+        std::snprintf(name, sizeof(name), "mem[%03X]", addr);
+        PrintDiff(name, a.memory[addr], b.memory[addr], 2);
+    }
+
+    for (unsigned row = 0; row < a.DISPLAY_HEIGHT; ++row)
+    {
+        if (a.screen[row] != b.screen[row])
+            std::printf("  row %-6u %016llX  %016llX\n", row, static_cast<unsigned long long>(a.screen[row]),
+                        static_cast<unsigned long long>(b.screen[row]));
+    }
+}
+
+int main(int argc, char **argv)
+{
+    RunOptions options;
+    Side sides[2];
+    bool haveConfig[2] = {false, false};
+    char const *moviePath = nullptr;
+    std::string error;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if ((arg == "--a" || arg == "--b") && hasValue)
+        {
+            int side = arg == "--a" ? 0 : 1;
+            if (!ParseConfig(argv[++i], sides[side].config))
+            {
+                std::cerr << "bad configuration: " << argv[i] << std::endl;
+                return 2;
+            }
+            haveConfig[side] = true;
+        }
+        else if (arg == "--movie" && hasValue)
+            moviePath = argv[++i];
+        else if (arg == "--aot" && hasValue)
+        {
+            if (!LoadAotProgram(argv[++i], options.aot, error))
+            {
+                std::cerr << error << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--input" && hasValue)
+        {
+            if (!LoadInputScript(argv[++i], options.input, error))
+            {
+                std::cerr << error << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--frames" && hasValue)
+            options.frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--ips" && hasValue)
+            options.ips = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--seed" && hasValue)
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg[0] != '-' && options.rom.empty())
+            options.rom = arg;
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    if (options.rom.empty() || !haveConfig[0] || !haveConfig[1] || options.ips == 0)
+    {
+        Usage();
+        return 2;
+    }
+
+    // Without a movie, record the input script on side A
+    Movie movie;
+    if (moviePath)
+    {
+        if (!ReadMovie(moviePath, movie, error))
+        {
+            std::cerr << error << std::endl;
+            return 2;
+        }
+    }
+    else
+    {
+        RunResult result;
+        options.core = sides[0].config.core;
+        options.keyframeFrames = 0;
+        if (!RunRom(options, *sides[0].chip, result, error, &movie))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+    }
+
+    for (Side &side : sides)
+    {
+        RunOptions sideOptions = options;
+        sideOptions.core = side.config.core;
+        if (!StartMovie(movie, options.rom.c_str(), *side.chip, error) || !SelectCore(sideOptions, *side.chip, error))
+        {
+            std::cerr << error << std::endl;
+            return 1;
+        }
+        side.chip->clipSprites = side.config.clipSprites;
+        side.chip->SaveState(side.agreed);
+    }
+
+    Chip8 &a = *sides[0].chip;
+    Chip8 &b = *sides[1].chip;
+    uint64_t comparisons = 0;
+    auto same = [&]
+    {
+        ++comparisons;
+        return a.StateHash() == b.StateHash();
+    };
+    auto runBoth = [&](uint64_t target)
+    {
+        for (Side &side : sides)
+        {
+            side.chip->LoadState(side.agreed);
+            RunTo(*side.chip, movie, target);
+        }
+    };
+    auto agree = [&]
+    {
+        for (Side &side : sides)
+            side.chip->SaveState(side.agreed);
+    };
+
+    // Gallop: checkpoints 1, 2, 4, ... instructions past the last agreement
+    uint64_t good = 0;
+    uint64_t bad = 0;
+    if (same())
+    {
+        for (uint64_t step = 1;; step *= 2)
+        {
+            uint64_t next = std::min(good + step, movie.cycles);
+            runBoth(next);
+            if (!same())
+            {
+                bad = next;
+                break;
+            }
+            good = next;
+            agree();
+            if (good == movie.cycles)
+            {
+                std::printf("%s and %s agree for all %llu instructions (%llu comparisons)\n",
+                            sides[0].config.name.c_str(), sides[1].config.name.c_str(),
+                            static_cast<unsigned long long>(movie.cycles),
+                            static_cast<unsigned long long>(comparisons));
+                return 0;
+            }
+        }
+
+        // Halve (good, bad] down to one instruction
+        while (bad - good > 1)
+        {
+            uint64_t mid = good + (bad - good) / 2;
+            runBoth(mid);
+            if (same())
+            {
+                good = mid;
+                agree();
+            }
+            else
+                bad = mid;
+        }
+    }
+
+    // The instruction at `good` is the first whose result differs
+    Snapshot const &before = sides[0].agreed;
+    uint16_t opcode = static_cast<uint16_t>(before.memory[before.pc & 0xFFF] << 8 | before.memory[(before.pc + 1) & 0xFFF]);
+    runBoth(bad);
+
+    std::printf("first divergence at cycle %llu after %llu comparisons\n",
+                static_cast<unsigned long long>(good), static_cast<unsigned long long>(comparisons));
+    if (bad > good)
+        std::printf("instruction: %03X  %04X\n", before.pc, opcode);
+    else
+        std::printf("the configurations differ from power-on\n");
+    std::printf("state after it (%s vs %s):\n", sides[0].config.name.c_str(), sides[1].config.name.c_str());
+    PrintStateDiff(a, b);
+    return 1;
+}
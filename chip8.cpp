@@ -1,4 +1,6 @@
 #include "chip8.hpp"
+#include "jit.hpp"
+#include "aot.hpp"
 #include <bits/stdc++.h>
 
 const uint16_t NNN_MASK = 0x0FFFu;
@@ -10,256 +12,728 @@ const uint8_t N_MASK = 0x000fu;
 const int DISPLAY_HEIGHT = 32;
 const int DISPLAY_WIDTH = 64;
 
-// Cycle
+#if defined(__OPTIMIZE__) || (defined(_MSC_VER) && !defined(_DEBUG))
+const bool Chip8::OPTIMIZED = true;
+#else
+const bool Chip8::OPTIMIZED = false;
+#endif
+
+// Map an opcode to its instruction id. Only used to build DECODE_TABLE.
+static constexpr Op DecodeOp(uint16_t op)
+{
+    switch (op & 0xf000u)
+    {
+    case 0x0000:
+        if (op == 0x00e0)
+            return OP_00E0;
+        if (op == 0x00ee)
+            return OP_00EE;
+        return OP_NULL;
+    case 0x1000:
+        return OP_1nnn;
+    case 0x2000:
+        return OP_2nnn;
+    case 0x3000:
+        return OP_3xkk;
+    case 0x4000:
+        return OP_4xkk;
+    case 0x5000:
+        return (op & 0x000f) == 0 ? OP_5xy0 : OP_NULL;
+    case 0x6000:
+        return OP_6xkk;
+    case 0x7000:
+        return OP_7xkk;
+    case 0x8000:
+        switch (op & 0x000f)
+        {
+        case 0x0:
+            return OP_8xy0;
+        case 0x1:
+            return OP_8xy1;
+        case 0x2:
+            return OP_8xy2;
+        case 0x3:
+            return OP_8xy3;
+        case 0x4:
+            return OP_8xy4;
+        case 0x5:
+            return OP_8xy5;
+        case 0x6:
+            return OP_8xy6;
+        case 0x7:
+            return OP_8xy7;
+        case 0xE:
+            return OP_8xyE;
+        }
+        return OP_NULL;
+    case 0x9000:
+        return (op & 0x000f) == 0 ? OP_9xy0 : OP_NULL;
+    case 0xA000:
+        return OP_Annn;
+    case 0xB000:
+        return OP_Bnnn;
+    case 0xC000:
+        return OP_Cxkk;
+    case 0xD000:
+        return OP_Dxyn;
+    case 0xE000:
+        switch (op & 0x00ff)
+        {
+        case 0x9e:
+            return OP_Ex9E;
+        case 0xa1:
+            return OP_ExA1;
+        }
+        return OP_NULL;
+    case 0xF000:
+        switch (op & 0x00ff)
+        {
+        case 0x07:
+            return OP_Fx07;
+        case 0x0a:
+            return OP_Fx0A;
+        case 0x15:
+            return OP_Fx15;
+        case 0x18:
+            return OP_Fx18;
+        case 0x1E:
+            return OP_Fx1E;
+        case 0x29:
+            return OP_Fx29;
+        case 0x33:
+            return OP_Fx33;
+        case 0x55:
+            return OP_Fx55;
+        case 0x65:
+            return OP_Fx65;
+        }
+        return OP_NULL;
+    }
+    return OP_NULL;
+}
+
+// Instruction id for every possible opcode, built at compile time (64 KB).
+static constexpr std::array<uint8_t, 0x10000> DECODE_TABLE = []
+{
+    std::array<uint8_t, 0x10000> table{};
+    for (uint32_t op = 0; op < 0x10000; ++op)
+        table[op] = DecodeOp(static_cast<uint16_t>(op));
+    return table;
+}();
+
+// Handler for every instruction id, in Op order.
+static constexpr void (Chip8::*OP_TABLE[OP_COUNT])(Instr const &) = {
+    &Chip8::OPNULL,
+    &Chip8::OP00E0,
+    &Chip8::OP00EE,
+    &Chip8::OP1nnn,
+    &Chip8::OP2nnn,
+    &Chip8::OP3xkk,
+    &Chip8::OP4xkk,
+    &Chip8::OP5xy0,
+    &Chip8::OP6xkk,
+    &Chip8::OP7xkk,
+    &Chip8::OP8xy0,
+    &Chip8::OP8xy1,
+    &Chip8::OP8xy2,
+    &Chip8::OP8xy3,
+    &Chip8::OP8xy4,
+    &Chip8::OP8xy5,
+    &Chip8::OP8xy6,
+    &Chip8::OP8xy7,
+    &Chip8::OP8xyE,
+    &Chip8::OP9xy0,
+    &Chip8::OPAnnn,
+    &Chip8::OPBnnn,
+    &Chip8::OPCxkk,
+    &Chip8::OPDxyn,
+    &Chip8::OPEx9E,
+    &Chip8::OPExA1,
+    &Chip8::OPFx07,
+    &Chip8::OPFx0A,
+    &Chip8::OPFx15,
+    &Chip8::OPFx18,
+    &Chip8::OPFx1E,
+    &Chip8::OPFx29,
+    &Chip8::OPFx33,
+    &Chip8::OPFx55,
+    &Chip8::OPFx65,
+};
+
+// Each handler wrapped in a plain function with its own call site, so
+// JIT blocks call handlers directly rather than through Execute
+template <void (Chip8::*Handler)(Instr const &)>
+static void CallOp(Chip8 *chip, Instr const *in)
+{
+    (chip->*Handler)(*in);
+}
+
+template <size_t... I>
+static constexpr std::array<Chip8::OpFunction, OP_COUNT> MakeOpFunctions(std::index_sequence<I...>)
+{
+    return {&CallOp<OP_TABLE[I]>...};
+}
+
+static constexpr auto OP_FUNCTIONS = MakeOpFunctions(std::make_index_sequence<OP_COUNT>());
+
+Chip8::OpFunction Chip8::Handler(uint8_t op)
+{
+    return OP_FUNCTIONS[op];
+}
+
+Op DecodeOpcode(uint16_t opcode)
+{
+    return static_cast<Op>(DECODE_TABLE[opcode]);
+}
+
+Chip8::~Chip8()
+{
+    delete jit;
+}
+
+// Cycle: one 60 Hz timer tick followed by a fixed burst of 12 instructions.
+// The frontends use Scheduler instead, which decouples the two.
 void Chip8::Cycle()
 {
+    TickTimers();
+    Step(12);
+}
 
-    // Timers
+// Decrement the delay and sound timers
+void Chip8::TickTimers()
+{
     if (d_timer > 0)
         --d_timer;
-    if (s_timer > 0)
-        --s_timer;
+    if (s_timer > 0 && --s_timer == 0)
+        SoundEdgeAt(false);
+}
+
+// Record that the tone starts or stops now
+void Chip8::SoundEdgeAt(bool on)
+{
+    if (soundEdgeCount == MAX_SOUND_EDGES)
+        --soundEdgeCount;
+    soundEdges[soundEdgeCount++] = {cycles, on};
+}
+
+// Run up to count instructions on the selected core. Returns how many ran;
+// fewer than count means execution stopped on a fault (see Fetch) or the
+// program went idle (see Idle).
+int Chip8::Step(int count)
+{
+    uint64_t start = cycles;
+    stepEnd = cycles + count;
+
+    if (core == Core::Threaded)
+        RunThreaded();
+    else if (core == Core::Jit)
+        RunJit();
+    else if (core == Core::Aot)
+        RunAot();
+    else
+        RunTable();
+
+    return static_cast<int>(cycles - start);
+}
+
+// Record a fault event, unless faults are compiled out
+inline void Chip8::Fault(TraceKind kind, uint16_t at, uint16_t op)
+{
+    if constexpr (TRACE_LEVEL >= TraceLevel::Faults)
+        trace.Push(kind, at, op);
+}
 
-    for (short i = 0; i < 12; i++)
+// Fetch the next instruction and advance pc. Returns nullptr when execution
+// has to stop (pc out of bounds or opcode 0).
+inline Instr *Chip8::Fetch()
+{
+    // Check for PC bounds BEFORE reading memory
+    if (pc < START_ADRESS || pc >= 4095)
     {
+        Fault(TraceKind::PcOutOfBounds, pc, 0);
+        return nullptr;
+    }
 
-        // Check for PC bounds BEFORE reading memory
-        if (pc < START_ADRESS || pc >= 4095)
-        {
-            std::cout << "ERROR: PC out of bounds: " << std::hex << pc << std::endl;
-            std::cout << "PC should be between " << std::hex << START_ADRESS << " and 4094" << std::endl;
+    uint16_t prevPC = pc; // Track previous PC
+
+    // Decode lazily the first time an address runs
+    Instr *in = &decoded[pc];
+    if (in->op == OP_UNDECODED)
+        Decode(pc);
+
+    opcode = in->opcode;
+    pc += 2;
+
+    if constexpr (TRACE_LEVEL >= TraceLevel::Instructions)
+        trace.Push(TraceKind::Instruction, prevPC, opcode);
+
+    // Special case for opcode 0
+    if (opcode == 0)
+    {
+        Fault(TraceKind::OpcodeZero, prevPC, opcode);
+        return nullptr; // Stop execution to prevent infinite loop
+    }
+
+    ++cycles;
+    return in;
+}
+
+// Table core: a dispatch loop making one indirect call per instruction
+void Chip8::RunTable()
+{
+    while (cycles < stepEnd)
+    {
+        Instr *in = Fetch();
+        if (!in)
             return;
-        }
 
-        uint16_t prevPC = pc; // Track previous PC
-        opcode = (memory[pc] << 8u) | memory[pc + 1];
-        pc += 2;
+        (this->*OP_TABLE[in->op])(*in);
+    }
+}
 
-        // Debug output
-        std::cout << "PC: " << std::hex << prevPC << " -> " << pc << " Opcode: " << std::hex << opcode << std::endl;
+// Run one instruction through the handler table
+void Chip8::Execute(Instr const &in)
+{
+    (this->*OP_TABLE[in.op])(in);
+}
+
+// Jit core: the table core, except that at every block entry the
+// translator gets a chance to count the entry or run native code for it.
+void Chip8::RunJit()
+{
+    if (!jit)
+        jit = new Jit(this);
 
-        // Special case for opcode 0
-        if (opcode == 0)
+    bool blockStart = true;
+    while (cycles < stepEnd)
+    {
+        // Native blocks would not leave per-instruction records
+        if (blockStart && TRACE_LEVEL < TraceLevel::Instructions &&
+            jit->Run(static_cast<int>(stepEnd - cycles)) > 0)
         {
-            std::cout << "WARNING: Executing opcode 0 at PC " << std::hex << prevPC << std::endl;
-            std::cout << "Memory at that location: " << std::hex << (int)memory[prevPC] << " " << (int)memory[prevPC + 1] << std::endl;
-            return; // Stop execution to prevent infinite loop
+            ++nativeBlocks;
+            continue;
         }
 
-        switch (opcode & 0xf000u)
+        Instr *in = Fetch();
+        if (!in)
+            return;
+
+        // Fx33/Fx55 may overwrite the instruction and invalidate *in
+        uint8_t op = in->op;
+        (this->*OP_TABLE[op])(*in);
+        blockStart = EndsBlock(op);
+    }
+}
+
+// Aot core: the table core, except that block entries with a compiled
+// function for them run that function instead. A step that ends inside a
+// block leaves pc there, and the next one resumes the block at that point.
+void Chip8::RunAot()
+{
+    bool blockStart = true;
+    while (cycles < stepEnd)
+    {
+        if (blockStart && TRACE_LEVEL < TraceLevel::Instructions && aot && pc < 4096 && aotBlockAt[pc] >= 0)
         {
-        case 0x0000:
-            switch (opcode)
-            {
-            case 0x00e0:
-                OP00E0();
-                break;
-            case 0x00ee:
-                OP00EE();
-                break;
-            }
-            break;
+            // No block runs anywhere near this many instructions; the cap
+            // leaves room for the entry offset added to the budget
+            int budget = static_cast<int>(std::min<uint64_t>(stepEnd - cycles, 0x10000));
+            aot->blocks[aotBlockAt[pc]].fn(*this, budget);
+            ++nativeBlocks;
+            continue;
+        }
 
-        case 0x1000:
-            OP1nnn();
-            break;
+        Instr *in = Fetch();
+        if (!in)
+            return;
 
-        case 0x2000:
-            OP2nnn();
-            break;
+        // Fx33/Fx55 may overwrite the instruction and invalidate *in
+        uint8_t op = in->op;
+        (this->*OP_TABLE[op])(*in);
+        blockStart = EndsBlock(op);
+    }
+}
 
-        case 0x3000:
-            OP3xkk();
-            break;
+// Use the blocks of a chip8-aot program. They are only enabled when the
+// program was built from the ROM currently in memory; LoadRom checks again.
+bool Chip8::AttachAot(AotProgram const *program)
+{
+    aot = program;
+    std::fill(std::begin(aotBlockAt), std::end(aotBlockAt), -1);
 
-        case 0x4000:
-            OP4xkk();
-            break;
+    if (!aot || aot->romSize > sizeof(memory) - START_ADRESS ||
+        std::memcmp(memory + START_ADRESS, aot->rom, aot->romSize) != 0)
+        return false;
 
-        case 0x5000:
-            OP5xy0();
-            break;
+    for (size_t i = 0; i < aot->blockCount; ++i)
+        aotBlockAt[aot->blocks[i].start] = static_cast<int16_t>(i);
 
-        case 0x6000:
-            OP6xkk();
-            break;
+    // Instructions inside a block resume it, unless a block starts there
+    for (size_t i = 0; i < aot->blockCount; ++i)
+    {
+        AotBlock const &block = aot->blocks[i];
+        for (uint32_t a = block.start + 2; a < block.end; a += 2)
+        {
+            if (aotBlockAt[a] < 0)
+                aotBlockAt[a] = static_cast<int16_t>(i);
+        }
+    }
 
-        case 0x7000:
-            OP7xkk();
-            break;
+    return true;
+}
 
-        case 0x8000:
-            switch (opcode & 0x000f)
-            {
-            case 0x0:
-                OP8xy0();
-                break;
-            case 0x1:
-                OP8xy1();
-                break;
-            case 0x2:
-                OP8xy2();
-                break;
-            case 0x3:
-                OP8xy3();
-                break;
-            case 0x4:
-                OP8xy4();
-                break;
-            case 0x5:
-                OP8xy5();
-                break;
-            case 0x6:
-                OP8xy6();
-                break;
-            case 0x7:
-                OP8xy7();
-                break;
-            case 0xE:
-                OP8xyE();
-                break;
-            }
-            break;
+#if defined(__GNUC__)
+// Threaded core: every handler ends by jumping straight to the handler of
+// the next instruction (labels-as-values), so there is no central loop.
+void Chip8::RunThreaded()
+{
+    static void *const LABELS[OP_COUNT] = {
+        &&L_NULL,
+        &&L_00E0,
+        &&L_00EE,
+        &&L_1nnn,
+        &&L_2nnn,
+        &&L_3xkk,
+        &&L_4xkk,
+        &&L_5xy0,
+        &&L_6xkk,
+        &&L_7xkk,
+        &&L_8xy0,
+        &&L_8xy1,
+        &&L_8xy2,
+        &&L_8xy3,
+        &&L_8xy4,
+        &&L_8xy5,
+        &&L_8xy6,
+        &&L_8xy7,
+        &&L_8xyE,
+        &&L_9xy0,
+        &&L_Annn,
+        &&L_Bnnn,
+        &&L_Cxkk,
+        &&L_Dxyn,
+        &&L_Ex9E,
+        &&L_ExA1,
+        &&L_Fx07,
+        &&L_Fx0A,
+        &&L_Fx15,
+        &&L_Fx18,
+        &&L_Fx1E,
+        &&L_Fx29,
+        &&L_Fx33,
+        &&L_Fx55,
+        &&L_Fx65,
+    };
+
+    Instr *in;
+
+#define DISPATCH()                \
+    do                            \
+    {                             \
+        if (cycles >= stepEnd)    \
+            return;               \
+        if (!(in = Fetch()))      \
+            return;               \
+        goto *LABELS[in->op];     \
+    } while (0)
+
+#define HANDLER(name) \
+    L_##name:         \
+    OP##name(*in);    \
+    DISPATCH()
+
+    DISPATCH();
+
+    HANDLER(NULL);
+    HANDLER(00E0);
+    HANDLER(00EE);
+    HANDLER(1nnn);
+    HANDLER(2nnn);
+    HANDLER(3xkk);
+    HANDLER(4xkk);
+    HANDLER(5xy0);
+    HANDLER(6xkk);
+    HANDLER(7xkk);
+    HANDLER(8xy0);
+    HANDLER(8xy1);
+    HANDLER(8xy2);
+    HANDLER(8xy3);
+    HANDLER(8xy4);
+    HANDLER(8xy5);
+    HANDLER(8xy6);
+    HANDLER(8xy7);
+    HANDLER(8xyE);
+    HANDLER(9xy0);
+    HANDLER(Annn);
+    HANDLER(Bnnn);
+    HANDLER(Cxkk);
+    HANDLER(Dxyn);
+    HANDLER(Ex9E);
+    HANDLER(ExA1);
+    HANDLER(Fx07);
+    HANDLER(Fx0A);
+    HANDLER(Fx15);
+    HANDLER(Fx18);
+    HANDLER(Fx1E);
+    HANDLER(Fx29);
+    HANDLER(Fx33);
+    HANDLER(Fx55);
+    HANDLER(Fx65);
+
+#undef HANDLER
+#undef DISPATCH
+}
+#else
+// Labels-as-values is a GCC/Clang extension; fall back to the table core.
+void Chip8::RunThreaded()
+{
+    RunTable();
+}
+#endif
 
-        case 0x9000:
-            OP9xy0();
-            break;
+// Fill the predecoded entry for the instruction at addr
+void Chip8::Decode(uint16_t addr)
+{
+    Instr &in = decoded[addr];
+    uint16_t op = (memory[addr] << 8u) | memory[addr + 1];
+
+    in.op = DECODE_TABLE[op];
+    in.x = (op & X_MASK) >> 8u;
+    in.y = (op & Y_MASK) >> 4u;
+    in.n = op & N_MASK;
+    in.kk = op & KK_MASK;
+    in.nnn = op & NNN_MASK;
+    in.opcode = op;
+}
 
-        case 0xA000:
-            OPAnnn();
-            break;
+// Drop predecoded entries that overlap memory[addr, addr + len). byProgram
+// is set for stores by the running program (Fx33, Fx55), as opposed to
+// loading a ROM or restoring a snapshot.
+void Chip8::Invalidate(uint32_t addr, uint32_t len, bool byProgram)
+{
+    // Writes through I wrap at 4 KiB
+    addr &= 0xFFF;
+    if (addr + len > sizeof(memory))
+    {
+        Invalidate(0, addr + len - sizeof(memory), byProgram);
+        len = sizeof(memory) - addr;
+    }
 
-        case 0xB000:
-            OPBnnn();
-            break;
+    // The instruction starting one byte earlier also reads memory[addr]
+    uint32_t first = addr > 0 ? addr - 1 : 0;
+    uint32_t last = std::min<uint32_t>(addr + len, sizeof(memory));
 
-        case 0xC000:
-            OPCxkk();
-            break;
+    for (uint32_t a = first; a < last; ++a)
+        decoded[a].op = OP_UNDECODED;
 
-        case 0xd000:
-            OPDxyn();
-            break;
+    if (jit)
+        jit->Invalidate(addr, len, byProgram);
 
-        case 0xe000:
-            switch (opcode & 0x00ff)
+    // Compiled blocks over modified bytes no longer match memory
+    if (aot)
+    {
+        for (size_t i = 0; i < aot->blockCount; ++i)
+        {
+            AotBlock const &block = aot->blocks[i];
+            if (block.start >= last || block.end <= first)
+                continue;
+            for (uint32_t a = block.start; a < block.end; a += 2)
             {
-            case 0x9e:
-                OPEx9E();
-                break;
-            case 0xa1:
-                OPExA1();
-                break;
+                if (aotBlockAt[a] == static_cast<int16_t>(i))
+                    aotBlockAt[a] = -1;
             }
-            break;
-
-        case 0xf000:
-            switch (opcode & 0x00ff)
-            {
-            case 0x07:
-                OPFx07();
-                break;
-            case 0x0a:
-                OPFx0A();
-                break;
-            case 0x15:
-                OPFx15();
-                break;
-            case 0x18:
-                OPFx18();
-                break;
-            case 0x1E:
-                OPFx1E();
-                break;
-            case 0x29:
-                OPFx29();
-                break;
-            case 0x33:
-                OPFx33();
-                break;
-            case 0x55:
-                OPFx55();
-                break;
-            case 0x65:
-                OPFx65();
-                break;
-            }
-            break;
-
-        default:
-            std::cout << "UNIMPLEMENTED OPCODE: " << std::hex << opcode << " at PC: " << (pc - 2) << std::endl;
-            std::cout << "Opcode family: " << std::hex << (opcode & 0xF000) << std::endl;
-
-            // Don't crash, just skip for now
-            break;
         }
     }
 }
 
-void Chip8::LoadRom(char const *filename)
+bool Chip8::LoadRom(char const *filename)
 {
     std::ifstream file(filename, std::ios::binary | std::ios::ate);
 
-    if (file.is_open())
+    if (!file.is_open())
     {
-        std::ifstream file(filename, std::ios::binary | std::ios::ate);
+        std::cerr << "Failed to load the ROM file: " << filename << std::endl;
+        return false;
+    }
 
-        if (file.is_open())
-        {
-            std::streampos size = file.tellg();
-            char *buffer = new char[size];
+    std::streampos size = file.tellg();
+    if (size > static_cast<std::streamoff>(sizeof(memory) - START_ADRESS))
+    {
+        std::cerr << "ROM too large: " << filename << std::endl;
+        return false;
+    }
 
-            file.seekg(0, std::ios::beg);
-            file.read(buffer, size);
-            file.close();
+    char *buffer = new char[size];
 
-            for (long i = 0; i <= size; ++i)
-            {
-                memory[START_ADRESS + i] = buffer[i];
-            }
+    file.seekg(0, std::ios::beg);
+    file.read(buffer, size);
+    file.close();
+
+    romHash = 14695981039346656037ull;
+    for (long i = 0; i < size; ++i)
+    {
+        memory[START_ADRESS + i] = buffer[i];
+        romHash = (romHash ^ static_cast<uint8_t>(buffer[i])) * 1099511628211ull;
+    }
+    Invalidate(START_ADRESS, static_cast<uint32_t>(size));
+
+    if (aot)
+        AttachAot(aot);
+
+    delete[] buffer;
+    return true;
+}
 
-            delete[] buffer;
+// FNV-1a hash of the machine state, for comparing runs
+uint64_t Chip8::StateHash() const
+{
+    uint64_t hash = 14695981039346656037ull;
+    auto mix = [&hash](void const *data, size_t size)
+    {
+        auto bytes = static_cast<uint8_t const *>(data);
+        for (size_t i = 0; i < size; ++i)
+        {
+            hash ^= bytes[i];
+            hash *= 1099511628211ull;
         }
-        else
+    };
+
+    mix(memory, sizeof(memory));
+    mix(registers, sizeof(registers));
+    mix(&IR, sizeof(IR));
+    mix(&pc, sizeof(pc));
+    mix(&sp, sizeof(sp));
+    mix(stack, sizeof(stack));
+    mix(keypad, sizeof(keypad));
+    mix(screen, sizeof(screen));
+    mix(&d_timer, sizeof(d_timer));
+    mix(&s_timer, sizeof(s_timer));
+    mix(&waitKey, sizeof(waitKey));
+    mix(&randGen.state, sizeof(randGen.state));
+    return hash;
+}
+
+void Chip8::SaveState(Snapshot &out) const
+{
+    std::memcpy(out.memory, memory, sizeof(memory));
+    std::memcpy(out.registers, registers, sizeof(registers));
+    out.IR = IR;
+    out.pc = pc;
+    out.sp = sp;
+    std::memcpy(out.stack, stack, sizeof(stack));
+    std::memcpy(out.keypad, keypad, sizeof(keypad));
+    out.waitKey = waitKey;
+    std::memcpy(out.screen, screen, sizeof(screen));
+    out.d_timer = d_timer;
+    out.s_timer = s_timer;
+    out.cycles = cycles;
+    out.timerPhase = timerPhase;
+    out.randGen = randGen;
+}
+
+void Chip8::LoadState(Snapshot const &in)
+{
+    // Code caches only need to forget the 64-byte blocks that differ
+    constexpr uint32_t BLOCK = 64;
+    for (uint32_t addr = 0; addr < sizeof(memory); addr += BLOCK)
+    {
+        if (std::memcmp(memory + addr, in.memory + addr, BLOCK) != 0)
         {
-            std::cerr << "Falied to load thr ROm file!" << std::endl;
+            std::memcpy(memory + addr, in.memory + addr, BLOCK);
+            Invalidate(addr, BLOCK);
         }
     }
+
+    for (unsigned row = 0; row < DISPLAY_HEIGHT; ++row)
+    {
+        if (screen[row] != in.screen[row])
+            dirtyRows |= 1u << row;
+    }
+
+    std::memcpy(registers, in.registers, sizeof(registers));
+    IR = in.IR;
+    pc = in.pc;
+    sp = in.sp;
+    std::memcpy(stack, in.stack, sizeof(stack));
+    std::memcpy(keypad, in.keypad, sizeof(keypad));
+    waitKey = in.waitKey;
+    std::memcpy(screen, in.screen, sizeof(screen));
+    d_timer = in.d_timer;
+    s_timer = in.s_timer;
+    cycles = in.cycles;
+    timerPhase = in.timerPhase;
+    randGen = in.randGen;
+}
+
+// Unknown opcode (includes 0nnn SYS, which is ignored on modern interpreters)
+void Chip8::OPNULL(Instr const &in)
+{
+    // Don't crash, just record it and skip
+    Fault(TraceKind::Unimplemented, pc - 2, in.opcode);
 }
 
 // Clear screen
-void Chip8::OP00E0()
+void Chip8::OP00E0(Instr const &)
 {
     std::memset(screen, 0, sizeof(screen));
+    dirtyRows = ~0u;
 };
 
 // return from subroutine
-void Chip8::OP00EE()
+void Chip8::OP00EE(Instr const &)
 {
     --sp;
-    pc = stack[sp];
+    pc = stack[sp & 0xF];
 }
 // jump to mem location
-void Chip8::OP1nnn()
+void Chip8::OP1nnn(Instr const &in)
 {
-    uint16_t nnn = opcode & NNN_MASK;
+    uint16_t from = pc - 2;
+    uint16_t nnn = in.nnn;
     pc = nnn;
+
+    if (nnn == from || IsTimerWait(nnn, from))
+        Idle();
+}
+
+// True when the loop nnn..from is `Fx07; 3xkk or 4xkk; 1nnn` on one Vx and
+// we are about to go round it again: nothing changes until the delay timer
+// ticks.
+bool Chip8::IsTimerWait(uint16_t nnn, uint16_t from) const
+{
+    if (from != nnn + 4 || nnn + 3u >= sizeof(memory))
+        return false;
+
+    uint16_t load = (memory[nnn] << 8u) | memory[nnn + 1];
+    uint16_t skip = (memory[nnn + 2] << 8u) | memory[nnn + 3];
+
+    return (load & 0xF0FFu) == 0xF007u &&
+           ((skip & 0xF000u) == 0x3000u || (skip & 0xF000u) == 0x4000u) &&
+           ((skip ^ load) & X_MASK) == 0;
+}
+
+// The program is spinning on state that only a timer tick or an input
+// event can change: end the current Step so the scheduler fast-forwards.
+void Chip8::Idle()
+{
+    stepEnd = cycles;
 }
 
 // call a subroutine
-void Chip8::OP2nnn()
+void Chip8::OP2nnn(Instr const &in)
 {
-    uint16_t nnn = opcode & NNN_MASK;
-    stack[sp] = pc;
+    uint16_t nnn = in.nnn;
+    stack[sp & 0xF] = pc;
     ++sp;
     pc = nnn;
 };
 
 // Skip next instruction if Vx = kk.
-void Chip8::OP3xkk()
+void Chip8::OP3xkk(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t kk = opcode & KK_MASK;
+    uint8_t x = in.x;
+    uint8_t kk = in.kk;
 
     if (registers[x] == kk)
     {
@@ -268,10 +742,10 @@ void Chip8::OP3xkk()
 };
 
 // Skip next instruction if Vx != kk.
-void Chip8::OP4xkk()
+void Chip8::OP4xkk(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t kk = opcode & KK_MASK;
+    uint8_t x = in.x;
+    uint8_t kk = in.kk;
 
     if (registers[x] != kk)
     {
@@ -280,10 +754,10 @@ void Chip8::OP4xkk()
 };
 
 // Skip next instruction if Vx = Vy.
-void Chip8::OP5xy0()
+void Chip8::OP5xy0(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     if (registers[x] == registers[y])
     {
@@ -293,60 +767,60 @@ void Chip8::OP5xy0()
 
 // Set Vx = kk.
 // The interpreter puts the value kk into register Vx.
-void Chip8::OP6xkk()
+void Chip8::OP6xkk(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t kk = opcode & KK_MASK;
+    uint8_t x = in.x;
+    uint8_t kk = in.kk;
 
     registers[x] = kk;
 };
 
 // Set Vx = Vx + kk.
 // Adds the value kk to the value of register Vx, then stores the result in Vx.
-void Chip8::OP7xkk()
+void Chip8::OP7xkk(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t kk = opcode & KK_MASK;
+    uint8_t x = in.x;
+    uint8_t kk = in.kk;
 
     registers[x] += kk;
 };
 
 // Set Vx = Vy.
 // Stores the value of register Vy in register Vx.
-void Chip8::OP8xy0()
+void Chip8::OP8xy0(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     registers[x] = registers[y];
 };
 
 // Set Vx = Vx OR Vy.
 // Performs a bitwise OR on the values of Vx and Vy, then stores the result in Vx.
-void Chip8::OP8xy1()
+void Chip8::OP8xy1(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     registers[x] = registers[x] | registers[y];
 };
 
 // Set Vx = Vx AND Vy.
 // Performs a bitwise AND on the values of Vx and Vy, then stores the result in Vx.
-void Chip8::OP8xy2()
+void Chip8::OP8xy2(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     registers[x] = registers[x] & registers[y];
 };
 
 // Set Vx = Vx XOR Vy.
 // Performs a bitwise exclusive OR on the values of Vx and Vy, then stores the result in Vx.
-void Chip8::OP8xy3()
+void Chip8::OP8xy3(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     registers[x] = registers[x] ^ registers[y];
 };
@@ -355,10 +829,10 @@ void Chip8::OP8xy3()
 // Set Vx = Vx + Vy, set VF = carry.
 // The values of Vx and Vy are added together. If the result is greater than 8 bits (i.e., > 255,) VF is set to 1, otherwise 0. Only the lowest 8 bits of the result are kept, and stored in Vx.
 
-void Chip8::OP8xy4()
+void Chip8::OP8xy4(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     uint16_t sum = registers[x] + registers[y];
 
@@ -373,10 +847,10 @@ void Chip8::OP8xy4()
 // 8xy5 - SUB Vx, Vy
 // Set Vx = Vx - Vy, set VF = NOT borrow.
 // If Vx > Vy, then VF is set to 1, otherwise 0. Then Vy is subtracted from Vx, and the results stored in Vx.
-void Chip8::OP8xy5()
+void Chip8::OP8xy5(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     uint8_t diff = registers[x] - registers[y];
 
@@ -397,10 +871,10 @@ void Chip8::OP8xy5()
 // 8xy6 - SHR Vx {, Vy}
 // Set Vx = Vx SHR 1.
 // If the least-significant bit of Vx is 1, then VF is set to 1, otherwise 0. Then Vx is divided by 2.
-void Chip8::OP8xy6()
+void Chip8::OP8xy6(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
     registers[x] = registers[y];
     uint8_t temp = registers[x] & 0x1u;
     registers[x] >>= 1;
@@ -410,10 +884,10 @@ void Chip8::OP8xy6()
 // 8xy7 - SUBN Vx, Vy
 // Set Vx = Vy - Vx, set VF = NOT borrow.
 // If Vy > Vx, then VF is set to 1, otherwise 0. Then Vx is subtracted from Vy, and the results stored in Vx.
-void Chip8::OP8xy7()
+void Chip8::OP8xy7(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8;
-    uint8_t y = (opcode & Y_MASK) >> 4;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     // registers[y] > registers[x] ? registers[0xf] = 1 : registers[0xf] = 0;
     registers[x] = registers[y] - registers[x];
@@ -427,10 +901,10 @@ void Chip8::OP8xy7()
 // 8xyE - SHL Vx {, Vy}
 // Set Vx = Vx SHL 1.
 // If the most-significant bit of Vx is 1, then VF is set to 1, otherwise to 0. Then Vx is multiplied by 2
-void Chip8::OP8xyE()
+void Chip8::OP8xyE(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
     registers[x] = registers[y];
     uint8_t msb = (registers[x] & 0x80u) >> 7u;
     registers[x] <<= 1;
@@ -440,10 +914,10 @@ void Chip8::OP8xyE()
 // 9xy0 - SNE Vx, Vy
 // Skip next instruction if Vx != Vy.
 // The values of Vx and Vy are compared, and if they are not equal, the program counter is increased by 2.
-void Chip8::OP9xy0()
+void Chip8::OP9xy0(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t y = (opcode & Y_MASK) >> 4u;
+    uint8_t x = in.x;
+    uint8_t y = in.y;
 
     if (registers[x] != registers[y])
     {
@@ -454,85 +928,122 @@ void Chip8::OP9xy0()
 // Annn - LD I, addr
 // Set I = nnn.
 // The value of register I is set to nnn.
-void Chip8::OPAnnn()
+void Chip8::OPAnnn(Instr const &in)
 {
-    uint16_t nnn = opcode & NNN_MASK;
+    uint16_t nnn = in.nnn;
     IR = nnn;
 };
 
 // Bnnn - JP V0, addr
 // Jump to location nnn + V0.
 // The program counter is set to nnn plus the value of V0.
-void Chip8::OPBnnn()
+void Chip8::OPBnnn(Instr const &in)
 {
-    uint16_t nnn = opcode & NNN_MASK;
+    uint16_t nnn = in.nnn;
     pc = nnn + registers[0];
 };
 
 // Cxkk - RND Vx, byte
 // Set Vx = random byte AND kk.
 // The interpreter generates a random number from 0 to 255, which is then ANDed with the value kk. The results are stored in Vx. See instruction 8xy2 for more information on AND.
-void Chip8::OPCxkk()
+void Chip8::OPCxkk(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
-    uint8_t kk = opcode & KK_MASK;
+    uint8_t x = in.x;
+    uint8_t kk = in.kk;
 
-    uint8_t randomVal = randByte(randGen);
+    uint8_t randomVal = randGen.Byte();
 
     registers[x] = kk & randomVal;
 };
 
-// Dxyn - DRW Vx, Vy, nibble
-// Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
-
-// The interpreter reads n bytes from memory, starting at the address stored in I. These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen. If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0. If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen. See instruction 8xy3 for more information on XOR, and section 2.4, Display, for more information on the Chip-8 screen and sprites.
-void Chip8::OPDxyn()
+static inline uint64_t RotateRight(uint64_t value, unsigned shift)
 {
+    return (value >> shift) | (value << ((64 - shift) & 63));
+}
 
-    uint8_t _x = (opcode & X_MASK) >> 8u;
-    uint8_t _y = (opcode & Y_MASK) >> 4u;
+// Draw HEIGHT rows starting at screen row y. keep masks off the columns a
+// clipped sprite loses past the right edge. Fixed trip count so each height
+// is unrolled.
+template <unsigned HEIGHT>
+static uint64_t DrawRows(uint64_t *screen, uint8_t const *sprite, unsigned x, unsigned y, uint64_t keep)
+{
+    uint64_t hit = 0;
+    for (unsigned row = 0; row < HEIGHT; ++row)
+    {
+        uint64_t bits = RotateRight(static_cast<uint64_t>(sprite[row]) << 56, x) & keep;
+        uint64_t &line = screen[(y + row) & (DISPLAY_HEIGHT - 1)];
+        hit |= line & bits;
+        line ^= bits;
+    }
+    return hit;
+}
 
-    uint8_t x = registers[_x] % DISPLAY_WIDTH;
-    uint8_t y = registers[_y] % DISPLAY_HEIGHT;
+template <size_t... H>
+static constexpr std::array<uint64_t (*)(uint64_t *, uint8_t const *, unsigned, unsigned, uint64_t), sizeof...(H)>
+MakeDrawTable(std::index_sequence<H...>)
+{
+    return {&DrawRows<H>...};
+}
 
-    uint8_t height = opcode & 0x000F;
+static constexpr auto DRAW_ROWS = MakeDrawTable(std::make_index_sequence<16>());
 
-    registers[0xF] = 0; // Reset collision flag
+bool DrawSprite(uint64_t screen[32], uint8_t const *sprite, unsigned n, unsigned x, unsigned y, bool clip)
+{
+    uint64_t keep = ~0ull;
+    if (clip)
+    {
+        keep >>= x;
+        n = std::min<unsigned>(n, DISPLAY_HEIGHT - y);
+    }
+    return DRAW_ROWS[n & 15](screen, sprite, x, y, keep) != 0;
+}
 
-    for (uint8_t row = 0; row < height; ++row)
+void ExpandFramebuffer(uint64_t const screen[32], uint32_t *pixels, uint32_t on, uint32_t off, uint32_t rows)
+{
+    for (int y = 0; y < DISPLAY_HEIGHT; ++y)
     {
-        uint8_t spriteByte = memory[IR + row];
+        if (!((rows >> y) & 1))
+            continue;
 
-        for (uint8_t col = 0; col < 8; ++col)
-        {
-            // Extract the pixel bit (either 0 or 1)
-            uint8_t spritePixel = (spriteByte >> (7 - col)) & 0x1;
+        uint64_t line = screen[y];
+        for (int x = 0; x < DISPLAY_WIDTH; ++x)
+            pixels[y * DISPLAY_WIDTH + x] = (line >> (63 - x)) & 1 ? on : off;
+    }
+}
 
-            // Wrap around if x + col >= DISPLAY_WIDTH
-            uint32_t posX = (x + col) % DISPLAY_WIDTH;
-            uint32_t posY = (y + row) % DISPLAY_HEIGHT;
+// Dxyn - DRW Vx, Vy, nibble
+// Display n-byte sprite starting at memory location I at (Vx, Vy), set VF = collision.
 
-            uint32_t index = posY * DISPLAY_WIDTH + posX;
+// The interpreter reads n bytes from memory, starting at the address stored in I. These bytes are then displayed as sprites on screen at coordinates (Vx, Vy). Sprites are XORed onto the existing screen. If this causes any pixels to be erased, VF is set to 1, otherwise it is set to 0. If the sprite is positioned so part of it is outside the coordinates of the display, it wraps around to the opposite side of the screen. See instruction 8xy3 for more information on XOR, and section 2.4, Display, for more information on the Chip-8 screen and sprites.
+void Chip8::OPDxyn(Instr const &in)
+{
+    uint8_t x = registers[in.x] % DISPLAY_WIDTH;
+    uint8_t y = registers[in.y] % DISPLAY_HEIGHT;
+    uint8_t height = in.n;
+
+    // Rows past the end of memory wrap to address 0
+    uint8_t const *sprite = &memory[IR & 0xFFF];
+    uint8_t wrapped[16];
+    if (IR + height > sizeof(memory))
+    {
+        for (uint8_t row = 0; row < height; ++row)
+            wrapped[row] = memory[(IR + row) & 0xFFF];
+        sprite = wrapped;
+    }
 
-            if (spritePixel)
-            {
-                // If the screen pixel is already set, we have a collision
-                if (screen[index] == 0xFFFFFFFF)
-                    registers[0xF] = 1;
+    registers[0xF] = DrawSprite(screen, sprite, height, x, y, clipSprites);
 
-                // XOR the pixel (toggle on/off)
-                screen[index] ^= 0xFFFFFFFF;
-            }
-        }
-    }
+    // Mark rows y .. y + height - 1, wrapping at the bottom
+    uint64_t touched = ((1ull << height) - 1) << y;
+    dirtyRows |= static_cast<uint32_t>(touched) | static_cast<uint32_t>(touched >> DISPLAY_HEIGHT);
 }
 
 // Ex9E - SKP Vx
 // Skip next instruction if key with the value of Vx is pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the down position, PC is increased by 2.
-void Chip8::OPEx9E()
+void Chip8::OPEx9E(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
     uint8_t key = registers[x];
 
     if (keypad[key & 0xF])
@@ -544,9 +1055,9 @@ void Chip8::OPEx9E()
 // ExA1 - SKNP Vx
 // Skip next instruction if key with the value of Vx is not pressed.
 // Checks the keyboard, and if the key corresponding to the value of Vx is currently in the up position, PC is increased by 2.
-void Chip8::OPExA1()
+void Chip8::OPExA1(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
     uint8_t key = registers[x];
 
     if (!keypad[key & 0xF])
@@ -558,9 +1069,9 @@ void Chip8::OPExA1()
 // Fx07 - LD Vx, DT
 // Set Vx = delay timer value.
 // The value of DT is placed into Vx.
-void Chip8::OPFx07()
+void Chip8::OPFx07(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
 
     registers[x] = d_timer;
 };
@@ -568,88 +1079,43 @@ void Chip8::OPFx07()
 // Fx0A - LD Vx, K
 // Wait for a key press, store the value of the key in Vx.
 
-// All execution stops until a key is pressed, then the value of that key is stored in Vx.
-void Chip8::OPFx0A()
+// All execution stops until a key is pressed and released again; the key
+// is stored on release, like the original interpreter. The key pressed
+// first is latched in waitKey while the program waits.
+void Chip8::OPFx0A(Instr const &in)
 {
-    uint8_t x = X_MASK >> 8u;
+    uint8_t x = in.x;
 
-    if (keypad[0])
-    {
-        registers[x] = 0;
-    }
-    else if (keypad[1])
-    {
-        registers[x] = 1;
-    }
-    else if (keypad[2])
-    {
-        registers[x] = 2;
-    }
-    else if (keypad[3])
-    {
-        registers[x] = 3;
-    }
-    else if (keypad[4])
-    {
-        registers[x] = 4;
-    }
-    else if (keypad[5])
+    if (waitKey < 0)
     {
-        registers[x] = 5;
-    }
-    else if (keypad[6])
-    {
-        registers[x] = 6;
-    }
-    else if (keypad[7])
-    {
-        registers[x] = 7;
-    }
-    else if (keypad[8])
-    {
-        registers[x] = 8;
-    }
-    else if (keypad[9])
-    {
-        registers[x] = 9;
-    }
-    else if (keypad[10])
-    {
-        registers[x] = 10;
-    }
-    else if (keypad[11])
-    {
-        registers[x] = 11;
-    }
-    else if (keypad[12])
-    {
-        registers[x] = 12;
-    }
-    else if (keypad[13])
-    {
-        registers[x] = 13;
-    }
-    else if (keypad[14])
-    {
-        registers[x] = 14;
-    }
-    else if (keypad[15])
-    {
-        registers[x] = 15;
+        for (int8_t key = 0; key < 16; ++key)
+        {
+            if (keypad[key])
+            {
+                waitKey = key;
+                break;
+            }
+        }
     }
-    else
+    else if (!keypad[waitKey])
     {
-        pc -= 2;
+        registers[x] = static_cast<uint8_t>(waitKey);
+        waitKey = -1;
+        return;
     }
+
+    // Nothing to do until the keypad changes
+    pc -= 2;
+    Idle();
 };
 
 // Fx15 - LD DT, Vx
 // Set delay timer = Vx.
 
 // DT is set equal to the value of Vx.
-void Chip8::OPFx15()
+void Chip8::OPFx15(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
 
     d_timer = registers[x];
 };
@@ -658,29 +1124,32 @@ void Chip8::OPFx15()
 // Set sound timer = Vx.
 
 // ST is set equal to the value of Vx.
-void Chip8::OPFx18()
+void Chip8::OPFx18(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
+    bool wasOn = s_timer > 0;
 
     s_timer = registers[x];
+    if (wasOn != (s_timer > 0))
+        SoundEdgeAt(!wasOn);
 };
 
 // Fx1E - ADD I, Vx
 // Set I = I + Vx.
 
 // The values of I and Vx are added, and the results are stored in I.
-void Chip8::OPFx1E()
+void Chip8::OPFx1E(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
     IR += registers[x];
 };
 
 // Fx29 - LD F, Vx
 // Set I = location of sprite for digit Vx.
 // The value of I is set to the location for the hexadecimal sprite corresponding to the value of Vx. See section 2.4, Display, for more information on the Chip-8 hexadecimal font.
-void Chip8::OPFx29()
+void Chip8::OPFx29(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
     uint8_t digit = registers[x];
 
     IR = FONTSET_START_ADDRESS + (5 * digit);
@@ -689,21 +1158,23 @@ void Chip8::OPFx29()
 // Fx33 - LD B, Vx
 // Store BCD representation of Vx in memory locations I, I+1, and I+2.
 // The interpreter takes the decimal value of Vx, and places the hundreds digit in memory at location in I, the tens digit at location I+1, and the ones digit at location I+2.
-void Chip8::OPFx33()
+void Chip8::OPFx33(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
     uint8_t val = registers[x];
 
     // Ones place
-    memory[IR + 2] = val % 10;
+    memory[(IR + 2) & 0xFFF] = val % 10;
     val /= 10;
 
     // tens
-    memory[IR + 1] = val % 10;
+    memory[(IR + 1) & 0xFFF] = val % 10;
     val /= 10;
 
     // hundreds
-    memory[IR] = val % 10;
+    memory[IR & 0xFFF] = val % 10;
+
+    Invalidate(IR, 3, true);
 };
 
 // Fx55 - LD [I], Vx
@@ -711,25 +1182,27 @@ void Chip8::OPFx33()
 
 // The interpreter copies the values of registers V0 through Vx into memory, starting at the address in I.
 
-void Chip8::OPFx55()
+void Chip8::OPFx55(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
 
     for (uint8_t i = 0; i <= x; ++i)
     {
-        memory[IR + i] = registers[i];
+        memory[(IR + i) & 0xFFF] = registers[i];
     }
+
+    Invalidate(IR, x + 1u, true);
 };
 
 // Fx65 - LD Vx, [I]
 // Read registers V0 through Vx from memory starting at location I.
 // The interpreter reads values from memory starting at location I into registers V0 through Vx.
-void Chip8::OPFx65()
+void Chip8::OPFx65(Instr const &in)
 {
-    uint8_t x = (opcode & X_MASK) >> 8u;
+    uint8_t x = in.x;
 
     for (uint8_t i = 0; i <= x; ++i)
     {
-        registers[i] = memory[IR + i];
+        registers[i] = memory[(IR + i) & 0xFFF];
     }
 }
\ No newline at end of file
@@ -6,6 +6,145 @@
 #include <chrono>
 #include <random>
 #include <bits/stdc++.h>
+#include "trace.hpp"
+
+// Instruction ids, one per handler. Every 16-bit opcode decodes to one of these.
+enum Op : uint8_t
+{
+    OP_NULL, // unknown / unimplemented opcode
+    OP_00E0,
+    OP_00EE,
+    OP_1nnn,
+    OP_2nnn,
+    OP_3xkk,
+    OP_4xkk,
+    OP_5xy0,
+    OP_6xkk,
+    OP_7xkk,
+    OP_8xy0,
+    OP_8xy1,
+    OP_8xy2,
+    OP_8xy3,
+    OP_8xy4,
+    OP_8xy5,
+    OP_8xy6,
+    OP_8xy7,
+    OP_8xyE,
+    OP_9xy0,
+    OP_Annn,
+    OP_Bnnn,
+    OP_Cxkk,
+    OP_Dxyn,
+    OP_Ex9E,
+    OP_ExA1,
+    OP_Fx07,
+    OP_Fx0A,
+    OP_Fx15,
+    OP_Fx18,
+    OP_Fx1E,
+    OP_Fx29,
+    OP_Fx33,
+    OP_Fx55,
+    OP_Fx65,
+    OP_COUNT,
+    OP_UNDECODED = OP_COUNT // predecoded entry not filled yet
+};
+
+// Predecoded instruction: handler id plus the operands unpacked once
+struct Instr
+{
+    uint8_t op = OP_UNDECODED;
+    uint8_t x;
+    uint8_t y;
+    uint8_t n;
+    uint8_t kk;
+    uint16_t nnn;
+    uint16_t opcode;
+};
+
+// Instruction id of a 16-bit opcode
+Op DecodeOpcode(uint16_t opcode);
+
+// XOR an n-row sprite (one byte per row, n < 16) onto a bit-packed screen
+// at (x, y), wrapping or clipping at the edges. Returns true if any lit
+// pixel was erased.
+bool DrawSprite(uint64_t screen[32], uint8_t const *sprite, unsigned n, unsigned x, unsigned y, bool clip);
+
+// Expand a bit-packed screen into 64 * 32 pixels of `on` or `off`. Only
+// the rows set in `rows` are written.
+void ExpandFramebuffer(uint64_t const screen[32], uint32_t *pixels, uint32_t on = 0xFFFFFFFF, uint32_t off = 0,
+                       uint32_t rows = ~0u);
+
+// The sound timer started (on) or stopped at `cycle`
+struct SoundEdge
+{
+    uint64_t cycle;
+    bool on;
+};
+
+// Interpreter core used by Cycle. Both produce identical state.
+enum class Core : uint8_t
+{
+    Table,    // dispatch loop through the handler table
+    Threaded, // computed-goto threaded code
+    Jit,      // table core plus x86-64 translation of hot blocks
+    Aot,      // table core plus blocks compiled ahead of time by chip8-aot
+};
+
+class Jit;
+struct AotProgram;
+
+// Random numbers for Cxkk: xorshift64*, one shift-xor round and a multiply
+// per byte. Its whole state is one word, so it is saved with the machine
+// and a run is reproduced by its seed. Seeds go through SplitMix64 so
+// nearby seeds give unrelated sequences.
+struct Rng
+{
+    uint64_t state = 1;
+
+    Rng() = default;
+    explicit Rng(uint64_t seed) { Seed(seed); }
+
+    void Seed(uint64_t seed)
+    {
+        uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        state = z ^ (z >> 31);
+        if (state == 0)
+            state = 1;
+    }
+
+    uint8_t Byte()
+    {
+        state ^= state >> 12;
+        state ^= state << 25;
+        state ^= state >> 27;
+        return static_cast<uint8_t>((state * 0x2545F4914F6CDD1Dull) >> 56);
+    }
+};
+
+// Everything that defines a running machine, as plain data so a copy is a
+// few KB of memcpy and a save file is this struct behind a header (see
+// savestate.hpp). Settings (core, ips, quirks) are not part of it. Change
+// the layout only together with SAVE_VERSION.
+struct Snapshot
+{
+    uint8_t memory[4096];
+    uint8_t registers[16];
+    uint16_t IR;
+    uint16_t pc;
+    uint8_t sp;
+    uint16_t stack[16];
+    uint8_t keypad[16];
+    int8_t waitKey;
+    uint64_t screen[32];
+    uint8_t d_timer;
+    uint8_t s_timer;
+    uint64_t cycles;
+    uint32_t timerPhase;
+    Rng randGen;
+};
 
 struct Chip8
 {
@@ -33,8 +172,18 @@ struct Chip8
     // Keys
     uint8_t keypad[16];
 
-    // video
-    uint32_t screen[64 * 32];
+    // Key latched by a pending Fx0A until it is released, -1 if none
+    int8_t waitKey = -1;
+
+    // video: one word per row, bit 63 is x = 0
+    uint64_t screen[32];
+
+    // Rows changed since the frontend last took them (bit n = row n); zero
+    // means the frame is unchanged. See TakeDirtyRows.
+    uint32_t dirtyRows = ~0u;
+
+    // Quirk: sprites are clipped at the screen edges instead of wrapping
+    bool clipSprites = false;
 
     // dealay + soud timer
     uint8_t d_timer;
@@ -43,6 +192,45 @@ struct Chip8
     // opcode
     uint16_t opcode;
 
+    // Sound on/off edges since the frontend last drained them. When full,
+    // the newest edge overwrites the last slot so the final state is kept.
+    static constexpr uint32_t MAX_SOUND_EDGES = 32;
+    SoundEdge soundEdges[MAX_SOUND_EDGES];
+    uint32_t soundEdgeCount = 0;
+
+    // Instruction slots elapsed; the time base for timers and events
+    uint64_t cycles = 0;
+
+    // CPU speed, and progress towards the next 60 Hz timer tick in units of
+    // 1/60 instruction (a tick is due when it reaches ips). See Scheduler.
+    uint32_t ips = 700;
+    uint32_t timerPhase = 0;
+
+    // Step runs until cycles reaches stepEnd; Idle() pulls it in
+    uint64_t stepEnd = 0;
+
+    // Interpreter core, can be switched at runtime
+    Core core = Core::Table;
+
+    // Fault and instruction trace, see trace.hpp
+    TraceRing trace;
+
+    // Block translator, created the first time the Jit core runs
+    Jit *jit = nullptr;
+
+    // Ahead-of-time compiled blocks for the loaded ROM, see AttachAot
+    AotProgram const *aot = nullptr;
+    int16_t aotBlockAt[4096];
+
+    // Blocks entered as native code by the Jit and Aot cores
+    uint64_t nativeBlocks = 0;
+
+    // Predecoded shadow of memory, one entry per address
+    Instr decoded[4096];
+
+    // FNV-1a hash of the ROM last loaded, to match save files to their game
+    uint64_t romHash = 0;
+
     // Load rom flag + rom path
     bool shouldLoad = false;
     char *romPath;
@@ -55,7 +243,15 @@ struct Chip8
 
     const unsigned int FONTSET_START_ADDRESS = 0x50;
 
-    Chip8() : randGen(std::chrono::system_clock::now().time_since_epoch().count())
+    // Runs are reproducible: the generator starts from DEFAULT_SEED until
+    // the frontend picks another seed
+    static constexpr uint64_t DEFAULT_SEED = 0;
+
+    // Whether chip8.cpp was compiled with optimization; chip8-bench warns
+    // when it was not
+    static const bool OPTIMIZED;
+
+    Chip8() : randGen(DEFAULT_SEED)
     {
         pc = START_ADRESS;
 
@@ -67,14 +263,19 @@ struct Chip8
         sp = 0;
         d_timer = 0;
         s_timer = 0;
-
-        // rg
-        randByte = std::uniform_int_distribution<uint8_t>(0, 255);
     }
 
-    std::default_random_engine randGen;
-    std::uniform_int_distribution<uint8_t> randByte;
+    ~Chip8();
 
+    // The destructor deletes jit, which points back at this machine; a copy
+    // would share it
+    Chip8(Chip8 const &) = delete;
+    Chip8 &operator=(Chip8 const &) = delete;
+
+    Rng randGen;
+
+    // Power on: everything but the ROM, settings and the generator, which
+    // keeps running unless reseeded
     void reset()
     {
         memset(screen, 0, sizeof(screen));
@@ -82,7 +283,17 @@ struct Chip8
         memset(registers, 0, sizeof(registers));
         memset(keypad, 0, sizeof(keypad));
         memset(stack, 0, sizeof(stack));
+        dirtyRows = ~0u;
+        soundEdgeCount = 0;
+        waitKey = -1;
         pc = START_ADRESS;
+        IR = 0;
+        sp = 0;
+        d_timer = 0;
+        s_timer = 0;
+        cycles = 0;
+        timerPhase = 0;
+        Invalidate(0, sizeof(memory));
 
         for (unsigned int i = 0; i < 80; ++i)
         {
@@ -110,44 +321,80 @@ struct Chip8
             0xF0, 0x80, 0xF0, 0x80, 0x80  // F
     };
 
-    void LoadRom(char const *filename);
+    bool LoadRom(char const *filename);
+    uint64_t StateHash() const;
+
+    // Copy the machine state out and back in. LoadState keeps predecoded
+    // and compiled code for memory the snapshot does not change, and marks
+    // only the screen rows that differ as dirty.
+    void SaveState(Snapshot &out) const;
+    void LoadState(Snapshot const &in);
     void Cycle();
+    int Step(int count);
+    void TickTimers();
+    void SoundEdgeAt(bool on);
+
+    // Dirty rows since the last call, for a frontend about to present
+    uint32_t TakeDirtyRows()
+    {
+        uint32_t rows = dirtyRows;
+        dirtyRows = 0;
+        return rows;
+    }
+
+    void RunTable();
+    void RunThreaded();
+    void RunJit();
+    void RunAot();
+    bool AttachAot(AotProgram const *program);
+    void Execute(Instr const &in);
+
+    // Handler for op as a plain function, for generated code to call
+    using OpFunction = void (*)(Chip8 *, Instr const *);
+    static OpFunction Handler(uint8_t op);
+    Instr *Fetch();
+    void Fault(TraceKind kind, uint16_t at, uint16_t op);
+    void Idle();
+    bool IsTimerWait(uint16_t nnn, uint16_t from) const;
+    void Decode(uint16_t addr);
+    void Invalidate(uint32_t addr, uint32_t len, bool byProgram = false);
 
     // OPCODES
-    void OP00E0();
-    void OP00EE();
-    void OP1nnn();
-    void OP2nnn();
-    void OP3xkk();
-    void OP4xkk();
-    void OP5xy0();
-    void OP6xkk();
-    void OP7xkk();
-    void OP8xy0();
-    void OP8xy1();
-    void OP8xy2();
-    void OP8xy3();
-    void OP8xy4();
-    void OP8xy5();
-    void OP8xy6();
-    void OP8xy7();
-    void OP8xyE();
-    void OP9xy0();
-    void OPAnnn();
-    void OPBnnn();
-    void OPCxkk();
-    void OPDxyn();
-    void OPEx9E();
-    void OPExA1();
-    void OPFx07();
-    void OPFx0A();
-    void OPFx15();
-    void OPFx18();
-    void OPFx1E();
-    void OPFx29();
-    void OPFx33();
-    void OPFx55();
-    void OPFx65();
+    void OPNULL(Instr const &in);
+    void OP00E0(Instr const &in);
+    void OP00EE(Instr const &in);
+    void OP1nnn(Instr const &in);
+    void OP2nnn(Instr const &in);
+    void OP3xkk(Instr const &in);
+    void OP4xkk(Instr const &in);
+    void OP5xy0(Instr const &in);
+    void OP6xkk(Instr const &in);
+    void OP7xkk(Instr const &in);
+    void OP8xy0(Instr const &in);
+    void OP8xy1(Instr const &in);
+    void OP8xy2(Instr const &in);
+    void OP8xy3(Instr const &in);
+    void OP8xy4(Instr const &in);
+    void OP8xy5(Instr const &in);
+    void OP8xy6(Instr const &in);
+    void OP8xy7(Instr const &in);
+    void OP8xyE(Instr const &in);
+    void OP9xy0(Instr const &in);
+    void OPAnnn(Instr const &in);
+    void OPBnnn(Instr const &in);
+    void OPCxkk(Instr const &in);
+    void OPDxyn(Instr const &in);
+    void OPEx9E(Instr const &in);
+    void OPExA1(Instr const &in);
+    void OPFx07(Instr const &in);
+    void OPFx0A(Instr const &in);
+    void OPFx15(Instr const &in);
+    void OPFx18(Instr const &in);
+    void OPFx1E(Instr const &in);
+    void OPFx29(Instr const &in);
+    void OPFx33(Instr const &in);
+    void OPFx55(Instr const &in);
+    void OPFx65(Instr const &in);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,289 @@
+// chip8-differential: run fuzzed and self-modifying ROMs on every core and
+// check that they agree on StateHash after every frame, once far above the
+// default speed and once at it. Registered with CTest; exits 1 and names the
+// ROM, core and frame of the first mismatch, or a Jit or Aot core that never
+// entered a native block. The same ROMs then run as lanes of Chip8Lanes
+// against the scalar core.
+//
+//   chip8-differential [--roms N] [--frames N]
+//
+// Random ROMs come from FuzzRom. The Aot core needs its blocks compiled
+// in, so the build runs chip8-fuzz and chip8-aot over a few fixed seeds and
+// links the result (DIFFERENTIAL_AOT, a null-terminated list).
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include "aot.hpp"
+#include "fuzz_rom.hpp"
+#include "lanes.hpp"
+#include "scheduler.hpp"
+
+extern AotProgram const *const DIFFERENTIAL_AOT[];
+
+struct CoreCase
+{
+    char const *name;
+    Core core;
+};
+
+// Far above the default, so blocks get hot, compiled, rewritten and entered
+// again within a second of emulated time
+static constexpr uint32_t IPS = 50000;
+
+// The default speed, where a Scheduler step is shorter than most blocks
+static constexpr uint32_t DEFAULT_IPS = 700;
+
+static const CoreCase CORES[] = {
+    {"table", Core::Table}, {"threaded", Core::Threaded}, {"jit", Core::Jit}, {"aot", Core::Aot}};
+
+// ROM under test and everything else that defines the run
+struct Case
+{
+    std::string name;
+    std::vector<uint8_t> rom;
+    uint32_t seed;
+    bool clipSprites;
+    AotProgram const *aot; // null: the Aot core is not compared
+};
+
+// Fresh machine with the case's ROM, seed and quirks
+static std::unique_ptr<Chip8> Boot(Case const &test, uint32_t ips)
+{
+    auto chip = std::make_unique<Chip8>();
+    chip->randGen.Seed(test.seed);
+    chip->clipSprites = test.clipSprites;
+    std::copy(test.rom.begin(), test.rom.end(), chip->memory + chip->START_ADRESS);
+    chip->Invalidate(chip->START_ADRESS, static_cast<uint32_t>(test.rom.size()));
+    chip->ips = ips;
+    return chip;
+}
+
+// State hash after each of `frames` frames on one core. Keys change at
+// fixed instruction slots drawn from the case seed, so that Ex9E, ExA1 and
+// Fx0A take both paths and every core sees the same edges. Adds the native
+// blocks the core entered to `nativeBlocks`.
+static std::vector<uint64_t> Run(Case const &test, Core core, uint32_t ips, uint32_t frames,
+                                 uint64_t &nativeBlocks)
+{
+    auto chip = Boot(test, ips);
+    chip->core = core;
+    if (core == Core::Aot && !chip->AttachAot(test.aot))
+        return {};
+
+    Scheduler scheduler(*chip);
+    std::mt19937 keys(test.seed);
+    uint8_t down[16] = {};
+    uint64_t slotsPerFrame = chip->ips / Scheduler::TIMER_HZ;
+
+    std::vector<uint64_t> hashes;
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        if (frame % 2 == 0)
+        {
+            uint8_t key = static_cast<uint8_t>(keys() % 16);
+            down[key] ^= 1;
+            scheduler.QueueKey({frame * slotsPerFrame + keys() % slotsPerFrame, key, down[key] != 0});
+        }
+        scheduler.RunFrames(1);
+        hashes.push_back(chip->StateHash());
+    }
+    nativeBlocks += chip->nativeBlocks;
+    return hashes;
+}
+
+// Compare every core against the table core; false on the first mismatch.
+// `nativeBlocks` sums the native block entries of each core in CORES.
+static bool Check(Case const &test, uint32_t ips, uint32_t frames, uint64_t (&nativeBlocks)[std::size(CORES)])
+{
+    std::vector<uint64_t> reference = Run(test, Core::Table, ips, frames, nativeBlocks[0]);
+
+    for (size_t i = 0; i < std::size(CORES); ++i)
+    {
+        CoreCase const &other = CORES[i];
+        if (other.core == Core::Table || (other.core == Core::Aot && !test.aot))
+            continue;
+
+        std::vector<uint64_t> hashes = Run(test, other.core, ips, frames, nativeBlocks[i]);
+        if (hashes.empty())
+        {
+            std::cerr << test.name << ": " << other.name << " could not attach its blocks" << std::endl;
+            return false;
+        }
+        for (uint32_t frame = 0; frame < frames; ++frame)
+        {
+            if (hashes[frame] != reference[frame])
+            {
+                char const *quirks = test.clipSprites ? "+clip" : "";
+                std::cerr << test.name << ": " << other.name << " differs from table after frame "
+                          << frame + 1 << " (chip8-bisect rom.ch8 --a table" << quirks << " --b "
+                          << other.name << quirks << " --ips " << ips << " --seed " << test.seed << ")"
+                          << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Keys held during `frame` of a lanes run. Lanes only take input between
+// Steps, so keys change at frame starts on both sides.
+static bool LaneKeyDown(Case const &test, uint32_t frame, uint8_t key)
+{
+    return (test.seed * 7 + frame * 3 + key) % 11 == 0;
+}
+
+// Run every case with the given quirk as one lane of a Chip8Lanes and
+// compare each lane with the table core after every frame. Returns the
+// number of cases that differ.
+static int CheckLanes(std::vector<Case> const &cases, bool clipSprites, uint32_t frames)
+{
+    std::vector<Case const *> group;
+    for (Case const &test : cases)
+    {
+        if (test.clipSprites == clipSprites)
+            group.push_back(&test);
+    }
+    if (group.empty())
+        return 0;
+
+    Chip8Lanes lanes(group.size());
+    lanes.ips = IPS;
+    lanes.clipSprites = clipSprites;
+
+    std::vector<std::unique_ptr<Chip8>> chips;
+    std::vector<Scheduler> schedulers;
+    chips.reserve(group.size());
+    schedulers.reserve(group.size());
+    for (size_t lane = 0; lane < group.size(); ++lane)
+    {
+        chips.push_back(Boot(*group[lane], IPS));
+        schedulers.emplace_back(*chips.back());
+        lanes.Load(lane, *chips.back());
+    }
+
+    int failed = 0;
+    std::vector<bool> differs(group.size());
+    auto stored = std::make_unique<Chip8>();
+    for (uint32_t frame = 0; frame < frames; ++frame)
+    {
+        for (size_t lane = 0; lane < group.size(); ++lane)
+        {
+            for (uint8_t key = 0; key < 16; ++key)
+            {
+                bool down = LaneKeyDown(*group[lane], frame, key);
+                chips[lane]->keypad[key] = down;
+                lanes.keypad[key][lane] = down;
+            }
+        }
+
+        lanes.RunFrames(1);
+        for (size_t lane = 0; lane < group.size(); ++lane)
+        {
+            schedulers[lane].RunFrames(1);
+            if (differs[lane])
+                continue;
+
+            lanes.Store(lane, *stored);
+            if (stored->StateHash() != chips[lane]->StateHash())
+            {
+                std::cerr << group[lane]->name << ": lane " << lane << " differs from table after frame "
+                          << frame + 1 << std::endl;
+                differs[lane] = true;
+                ++failed;
+            }
+        }
+    }
+    return failed;
+}
+
+int main(int argc, char **argv)
+{
+    uint32_t roms = 200;
+    uint32_t frames = 60;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--roms" && i + 1 < argc)
+            roms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--frames" && i + 1 < argc)
+            frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else
+        {
+            std::cerr << "usage: chip8-differential [--roms N] [--frames N]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<Case> cases;
+    for (FuzzKind kind : {FuzzKind::Random, FuzzKind::SelfModifying})
+    {
+        for (uint32_t seed = 1; seed <= roms; ++seed)
+        {
+            cases.push_back({"chip8-fuzz " + std::to_string(seed) + " rom.ch8 " + FuzzKindName(kind),
+                             FuzzRom(seed, kind), seed, seed % 2 == 0, nullptr});
+        }
+    }
+    // The compiled-in ROMs come from the same seeds; rerun those cases
+    // with the Aot core added
+    size_t fuzzed = cases.size();
+    for (size_t i = 0; DIFFERENTIAL_AOT[i]; ++i)
+    {
+        AotProgram const *aot = DIFFERENTIAL_AOT[i];
+        Case test{"aot program " + std::to_string(i), std::vector<uint8_t>(aot->rom, aot->rom + aot->romSize),
+                  static_cast<uint32_t>(i), false, aot};
+        for (size_t j = 0; j < fuzzed; ++j)
+        {
+            if (cases[j].rom == test.rom)
+            {
+                test = cases[j];
+                test.aot = aot;
+                break;
+            }
+        }
+        cases.push_back(test);
+    }
+
+    int failed = 0;
+    for (uint32_t ips : {IPS, DEFAULT_IPS})
+    {
+        int differ = 0;
+        uint64_t nativeBlocks[std::size(CORES)] = {};
+        for (Case const &test : cases)
+        {
+            if (!Check(test, ips, frames, nativeBlocks))
+                ++differ;
+        }
+        std::cout << "chip8-differential: " << cases.size() - differ << " of " << cases.size()
+                  << " ROMs agree on every core at " << ips << " IPS" << std::endl;
+        failed += differ;
+
+        // Agreement means little if the compiled cores left everything to
+        // the interpreter
+        for (size_t i = 0; i < std::size(CORES); ++i)
+        {
+            if (CORES[i].core != Core::Jit && CORES[i].core != Core::Aot)
+                continue;
+            std::cout << "chip8-differential: " << CORES[i].name << " entered " << nativeBlocks[i]
+                      << " native blocks" << std::endl;
+            if (nativeBlocks[i] == 0)
+            {
+                std::cerr << CORES[i].name << " never entered a native block at " << ips << " IPS" << std::endl;
+                ++failed;
+            }
+        }
+    }
+
+    // The compiled-in ROMs are duplicates here
+    std::vector<Case> laneCases(cases.begin(), cases.begin() + fuzzed);
+    int laneFailed = CheckLanes(laneCases, false, frames) + CheckLanes(laneCases, true, frames);
+    std::cout << "chip8-differential: " << laneCases.size() - laneFailed << " of " << laneCases.size()
+              << " ROMs agree between lanes and the scalar core" << std::endl;
+
+    return failed == 0 && laneFailed == 0 ? 0 : 1;
+}
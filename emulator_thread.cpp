@@ -0,0 +1,376 @@
+#include "emulator_thread.hpp"
+#include "frame_pacer.hpp"
+#include "savestate.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+
+double HostTime()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+EmulatorThread::EmulatorThread() : chip(std::make_unique<Chip8>()), scheduler(*chip)
+{
+}
+
+EmulatorThread::~EmulatorThread()
+{
+    Stop();
+}
+
+void EmulatorThread::Start()
+{
+    if (running.exchange(true))
+        return;
+    thread = std::thread(&EmulatorThread::Run, this);
+}
+
+void EmulatorThread::Stop()
+{
+    running = false;
+    if (thread.joinable())
+        thread.join();
+}
+
+bool EmulatorThread::Send(Command command)
+{
+    return commands.Push(std::move(command));
+}
+
+Frame const *EmulatorThread::TakeFrame()
+{
+    return frames.Acquire() ? &frames.Front() : nullptr;
+}
+
+// True once per 60 Hz frame of host time. Slices are not a whole fraction
+// of a frame, so `last` moves in frame steps rather than to `now`.
+static bool FrameDue(double &last, double now)
+{
+    constexpr double FRAME = 1.0 / Scheduler::TIMER_HZ;
+    if (now - last < FRAME)
+        return false;
+    last = now - last < 2 * FRAME ? last + FRAME : now;
+    return true;
+}
+
+void EmulatorThread::Run()
+{
+    // Advance measures real elapsed time, so plain sleeps are precise enough
+    FramePacer pacer(SLICE_HZ, std::chrono::microseconds(0));
+    double last = HostTime();
+
+    while (running.load(std::memory_order_relaxed))
+    {
+        // Emulate exactly the time that passed since the last slice
+        double end = HostTime();
+        double elapsed = end - last;
+
+        Command command;
+        while (commands.Pop(command))
+            Apply(command, last, end);
+        last = end;
+
+        bool frameDue = FrameDue(lastHistory, end);
+
+        if (ready && rewinding)
+        {
+            if (frameDue)
+                StepBack();
+        }
+        else if (ready)
+        {
+            scheduler.Advance(elapsed);
+            PublishSound();
+
+            // Report whatever the core traced this frame
+            PrintTrace(std::cout, chip->trace, traceCursor);
+
+            if (frameDue)
+            {
+                chip->SaveState(saved);
+                rewind.Push(saved);
+            }
+
+            if (recording && chip->cycles >= nextKeyframe)
+            {
+                AddKeyframe(movie, *chip);
+                nextKeyframe = chip->cycles + KeyframeCycles();
+            }
+        }
+
+        if (ready && runAhead > 0 && !rewinding)
+        {
+            // Once per displayed frame is enough
+            if (FrameDue(lastRunAhead, end))
+                RunAhead();
+        }
+        else
+        {
+            // Rows the UI has from a run-ahead screen differ in unknown ways
+            uint32_t dirty = chip->TakeDirtyRows();
+            if (publishedAhead)
+                dirty = ~0u;
+            publishedAhead = false;
+            PublishFrame(chip->screen, dirty);
+        }
+
+        pacer.Wait();
+    }
+
+    StopRecording();
+}
+
+// Commands are applied before the slice (sliceStart, sliceEnd] is run
+void EmulatorThread::Apply(Command &command, double sliceStart, double sliceEnd)
+{
+    switch (command.kind)
+    {
+    case Command::KeyEdge:
+    {
+        // Place the edge at the instruction matching its host time within
+        // this slice; edges that arrived late land at its start
+        double length = std::min(sliceEnd - sliceStart, Scheduler::MAX_ADVANCE);
+        double into = std::clamp(command.time - sliceStart, 0.0, length);
+        uint64_t cycle = chip->cycles + static_cast<uint64_t>(into * chip->ips);
+        lastKeyCycle = std::max(lastKeyCycle, cycle);
+
+        KeyEdge edge{lastKeyCycle, static_cast<uint8_t>(command.value & 0xF), (command.value >> 8) != 0};
+        scheduler.QueueKey(edge);
+        if (recording)
+            movie.edges.push_back(edge);
+        break;
+    }
+
+    case Command::LoadRom:
+        StopRecording();
+        Boot(command.path);
+        break;
+
+    case Command::Record:
+        if (!ready)
+            break;
+        StopRecording();
+
+        // Movies start from power-on with a known seed
+        Boot(romPath);
+        BeginMovie(movie, *chip, seed);
+        moviePath = command.path;
+        recording = true;
+        nextKeyframe = KeyframeCycles();
+        break;
+
+    case Command::StopRecord:
+        StopRecording();
+        break;
+
+    case Command::SetCore:
+        chip->core = static_cast<Core>(command.value);
+        break;
+
+    case Command::SetIps:
+        // Timing is part of a movie
+        if (command.value > 0 && command.value != chip->ips)
+        {
+            StopRecording();
+            chip->ips = command.value;
+        }
+        break;
+
+    case Command::SetRunAhead:
+        runAhead = static_cast<uint8_t>(std::min<uint32_t>(command.value, MAX_RUN_AHEAD));
+        break;
+
+    case Command::SaveSlot:
+    {
+        std::string error;
+        if (ready && !WriteSaveState(SlotPath(command.value).c_str(), *chip, error))
+            std::cerr << error << std::endl;
+        break;
+    }
+
+    case Command::LoadSlot:
+    {
+        std::string error;
+        if (!ready)
+            break;
+        StopRecording();
+        if (!ReadSaveState(SlotPath(command.value).c_str(), chip->romHash, saved, error))
+        {
+            std::cerr << error << std::endl;
+            break;
+        }
+
+        Restore(saved);
+        sounds.Push({soundTime, chip->s_timer > 0});
+        break;
+    }
+
+    case Command::Rewind:
+        if (rewinding == (command.value != 0))
+            break;
+        rewinding = command.value != 0;
+
+        // Silent while going back, then resume from the state reached
+        sounds.Push({soundTime, !rewinding && chip->s_timer > 0});
+        break;
+    }
+}
+
+std::string EmulatorThread::SlotPath(uint32_t slot) const
+{
+    return romPath + ".state" + std::to_string(slot);
+}
+
+// Power on and load the ROM at path, seeded from the clock
+void EmulatorThread::Boot(std::string const &path)
+{
+    chip->reset();
+    seed = static_cast<uint64_t>(std::chrono::system_clock::now().time_since_epoch().count());
+    chip->randGen.Seed(seed);
+    ready = chip->LoadRom(path.c_str());
+    romPath = ready ? path : std::string();
+    rewind.Clear();
+    scheduler.Reset();
+    lastKeyCycle = chip->cycles;
+    soundCycle = chip->cycles;
+    sounds.Push({soundTime, false});
+}
+
+uint64_t EmulatorThread::KeyframeCycles() const
+{
+    return static_cast<uint64_t>(MOVIE_KEYFRAME_FRAMES) * chip->ips / Scheduler::TIMER_HZ;
+}
+
+void EmulatorThread::StopRecording()
+{
+    if (!recording)
+        return;
+    recording = false;
+
+    std::string error;
+    EndMovie(movie, *chip);
+    if (!WriteMovie(moviePath.c_str(), movie, error))
+        std::cerr << error << std::endl;
+}
+
+// Go back one frame, or stay on the oldest one
+void EmulatorThread::StepBack()
+{
+    if (rewind.Pop(saved))
+        Restore(saved);
+}
+
+// Jump to state. The keys held right now stay held: queued key edges are
+// applied first, and keys that differ from the state are queued as edges
+// at its cycle. Sound restarts from the new timer value.
+void EmulatorThread::Restore(Snapshot const &state)
+{
+    scheduler.FlushKeys();
+    scheduler.Reset();
+
+    uint8_t keypad[16];
+    std::copy(std::begin(chip->keypad), std::end(chip->keypad), keypad);
+    chip->LoadState(state);
+
+    // The recording continues from here
+    if (recording)
+    {
+        TruncateMovie(movie, chip->cycles);
+        nextKeyframe = chip->cycles + KeyframeCycles();
+    }
+
+    for (uint8_t key = 0; key < 16; ++key)
+    {
+        if (state.keypad[key] == keypad[key])
+            continue;
+        KeyEdge edge{chip->cycles, key, keypad[key] != 0};
+        scheduler.QueueKey(edge);
+        if (recording)
+            movie.edges.push_back(edge);
+    }
+
+    lastKeyCycle = chip->cycles;
+    soundCycle = chip->cycles;
+    chip->soundEdgeCount = 0;
+}
+
+// Convert this slice's sound edges from cycles to emulated seconds
+void EmulatorThread::PublishSound()
+{
+    double perCycle = 1.0 / chip->ips;
+
+    for (uint32_t i = 0; i < chip->soundEdgeCount; ++i)
+    {
+        SoundEdge const &edge = chip->soundEdges[i];
+        sounds.Push({soundTime + (edge.cycle - soundCycle) * perCycle, edge.on});
+    }
+    chip->soundEdgeCount = 0;
+
+    soundTime += (chip->cycles - soundCycle) * perCycle;
+    soundCycle = chip->cycles;
+}
+
+// Snapshot, run runAhead frames with the keys as they are now, publish that
+// screen and restore. Sound and trace records from the speculative frames
+// are dropped: audio only ever follows the real timeline.
+void EmulatorThread::RunAhead()
+{
+    chip->SaveState(saved);
+    uint32_t realDirty = chip->TakeDirtyRows();
+    uint32_t soundEdges = chip->soundEdgeCount;
+    TraceRing::State trace = chip->trace.Save();
+
+    Scheduler ahead(*chip);
+    ahead.RunFrames(runAhead);
+
+    uint64_t screen[32];
+    std::copy(std::begin(chip->screen), std::end(chip->screen), screen);
+
+    chip->LoadState(saved);
+    chip->dirtyRows = realDirty;
+    chip->soundEdgeCount = soundEdges;
+    chip->trace.Restore(trace);
+
+    uint32_t dirty = 0;
+    for (int row = 0; row < 32; ++row)
+        if (screen[row] != publishedScreen[row])
+            dirty |= 1u << row;
+    if (!publishedAhead)
+        dirty = ~0u;
+    publishedAhead = true;
+
+    PublishFrame(screen, dirty);
+}
+
+void EmulatorThread::PublishFrame(uint64_t const *screen, uint32_t dirty)
+{
+    Frame &frame = frames.Back();
+    std::copy(screen, screen + 32, frame.screen);
+    std::copy(screen, screen + 32, publishedScreen);
+    dirty |= carriedRows;
+    frame.dirtyRows = dirty;
+    frame.soundTimer = chip->s_timer;
+    frame.cycles = chip->cycles;
+
+    // A frame replaced before the UI took it still owes its dirty rows
+    carriedRows = frames.Publish() ? dirty : 0;
+
+    DebugState state;
+    state.pc = chip->pc;
+    state.I = chip->IR;
+    std::copy(std::begin(chip->registers), std::end(chip->registers), state.v);
+    state.sp = chip->sp;
+    std::copy(std::begin(chip->stack), std::end(chip->stack), state.stack);
+    state.delay = chip->d_timer;
+    state.sound = chip->s_timer;
+    state.cycles = chip->cycles;
+    state.ips = chip->ips;
+    state.core = chip->core;
+    state.runAhead = runAhead;
+    state.rewinding = rewinding;
+    state.history = static_cast<uint32_t>(rewind.Frames());
+    state.recording = recording;
+    state.ready = ready;
+    debug.Store(state);
+}
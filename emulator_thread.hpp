@@ -0,0 +1,172 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include "chip8.hpp"
+#include "movie.hpp"
+#include "rewind.hpp"
+#include "scheduler.hpp"
+#include "seqlock.hpp"
+#include "spsc_queue.hpp"
+#include "triple_buffer.hpp"
+
+// The screen after an emulation slice, handed from the emulation thread to
+// the UI
+struct Frame
+{
+    uint64_t screen[32];
+    uint32_t dirtyRows;  // rows changed since the last frame the UI took
+    uint8_t soundTimer;
+    uint64_t cycles;
+};
+
+// Sound edge for the audio thread, stamped in seconds of emulated time
+struct SoundEvent
+{
+    double time;
+    bool on;
+};
+
+// Machine state for debugger views, consistent as of one frame
+struct DebugState
+{
+    uint16_t pc;
+    uint16_t I;
+    uint8_t v[16];
+    uint8_t sp;
+    uint16_t stack[16];
+    uint8_t delay;
+    uint8_t sound;
+    uint64_t cycles;
+    uint32_t ips;
+    Core core;
+    uint8_t runAhead;
+    bool rewinding;
+    uint32_t history; // frames that can be rewound
+    bool recording;
+    bool ready; // a ROM is loaded
+};
+
+// Request from the UI thread to the emulation thread
+struct Command
+{
+    enum Kind : uint8_t
+    {
+        KeyEdge, // value: key | down << 8, at host time `time`
+        LoadRom, // path
+        SetCore, // value: Core
+        SetIps,  // value: instructions per second
+        SetRunAhead, // value: frames, 0 (off) to MAX_RUN_AHEAD
+        SaveSlot,    // value: quick-save slot, 1 to SAVE_SLOTS
+        LoadSlot,    // value: quick-save slot, 1 to SAVE_SLOTS
+        Rewind,      // value: 1 while rewind is held, 0 on release
+        Record,      // path: restart the ROM and record a movie there
+        StopRecord,
+    };
+
+    Kind kind;
+    uint32_t value = 0;
+    std::string path;
+    double time = 0.0; // seconds on HostTime()
+};
+
+// Host clock for stamping commands: steady_clock in seconds
+double HostTime();
+
+// Runs a Chip8 on its own thread so UI stalls do not stall emulation.
+// Frames go to the UI through a triple buffer, commands come back through
+// an SPSC queue and debugger views read a seqlocked snapshot; none of the
+// three take a lock. Only one UI thread may call Send and TakeFrame, and
+// only one audio thread TakeSoundEvent.
+class EmulatorThread
+{
+public:
+    // Emulation runs in slices of 1/SLICE_HZ s. Sound edges reach the audio
+    // thread at the end of their slice, so this bounds audio latency.
+    static constexpr uint32_t SLICE_HZ = 240;
+
+    // Run-ahead: show the screen N 60 Hz frames ahead of the real state,
+    // computed with the current keys and thrown away again. Hides the
+    // frames of lag a ROM has between reading a key and drawing.
+    static constexpr uint8_t MAX_RUN_AHEAD = 4;
+
+    // Quick-save slots live next to the ROM as <rom>.state1 and so on
+    static constexpr uint32_t SAVE_SLOTS = 4;
+
+    EmulatorThread();
+    ~EmulatorThread();
+
+    EmulatorThread(EmulatorThread const &) = delete;
+    EmulatorThread &operator=(EmulatorThread const &) = delete;
+
+    void Start();
+    void Stop();
+
+    // Queue a command; false if the queue is full
+    bool Send(Command command);
+
+    // The latest complete frame, or nullptr if none was finished since the
+    // last call. The pointer stays valid until the next call.
+    Frame const *TakeFrame();
+
+    DebugState Debug() const { return debug.Load(); }
+
+    // Next sound edge, oldest first; false when there is none
+    bool TakeSoundEvent(SoundEvent &event) { return sounds.Pop(event); }
+
+private:
+    void Run();
+    void Apply(Command &command, double sliceStart, double sliceEnd);
+    void PublishFrame(uint64_t const *screen, uint32_t dirty);
+    void RunAhead();
+    void StepBack();
+    void Restore(Snapshot const &state);
+    void Boot(std::string const &path);
+    void StopRecording();
+    uint64_t KeyframeCycles() const;
+    std::string SlotPath(uint32_t slot) const;
+    void PublishSound();
+
+    std::unique_ptr<Chip8> chip;
+    Scheduler scheduler;
+    bool ready = false;
+    uint32_t carriedRows = 0; // dirty rows of frames the UI never took
+    uint64_t traceCursor = 0;
+    uint64_t lastKeyCycle = 0; // key edges are queued in cycle order
+
+    std::string romPath;
+    uint64_t seed = Chip8::DEFAULT_SEED; // the ROM was booted with
+
+    uint8_t runAhead = 0;
+    double lastRunAhead = 0.0;  // host time of the last run-ahead frame
+    bool publishedAhead = false; // the UI holds a run-ahead screen
+    uint64_t publishedScreen[32] = {};
+    Snapshot saved;
+
+    // One snapshot per 60 Hz frame while running; popped at the same rate
+    // while rewinding
+    RewindBuffer rewind;
+    bool rewinding = false;
+    double lastHistory = 0.0; // host time of the last push or pop
+
+    // Movie being recorded, see movie.hpp. Key edges are added as they are
+    // queued; going back in time cuts the recording there.
+    bool recording = false;
+    Movie movie;
+    std::string moviePath;
+    uint64_t nextKeyframe = 0; // cycle from which the next keyframe is taken
+
+    // Emulated time at soundCycle, for stamping sound edges
+    double soundTime = 0.0;
+    uint64_t soundCycle = 0;
+
+    SpscQueue<Command, 64> commands;
+    TripleBuffer<Frame> frames;
+    SeqLock<DebugState> debug;
+    SpscQueue<SoundEvent, 256> sounds;
+
+    std::thread thread;
+    std::atomic<bool> running{false};
+};
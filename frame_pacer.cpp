@@ -0,0 +1,63 @@
+#include "frame_pacer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+
+FramePacer::FramePacer(double hz, std::chrono::microseconds spin)
+    : period(std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(1.0 / hz))), spin(spin)
+{
+    Reset();
+}
+
+void FramePacer::Reset()
+{
+    deadline = Clock::now();
+    lastWake = deadline;
+    std::fill(std::begin(histogram), std::end(histogram), 0);
+    frames = 0;
+    overruns = 0;
+    worstJitter = 0.0;
+}
+
+void FramePacer::Wait()
+{
+    deadline += period;
+
+    Clock::time_point now = Clock::now();
+    if (now >= deadline + period)
+    {
+        // Too far behind: drop the missed frames rather than spiral
+        ++overruns;
+        deadline = now;
+    }
+    else
+    {
+        if (deadline - now > spin)
+            std::this_thread::sleep_until(deadline - spin);
+        while (Clock::now() < deadline)
+            std::this_thread::yield();
+    }
+
+    Clock::time_point wake = Clock::now();
+    double jitter = std::abs(std::chrono::duration<double>(wake - lastWake - period).count());
+    lastWake = wake;
+
+    int bucket = static_cast<int>(jitter * 1e6 / BUCKET_US);
+    ++histogram[std::min(bucket, BUCKETS - 1)];
+    ++frames;
+    worstJitter = std::max(worstJitter, jitter);
+}
+
+void PrintPacing(std::ostream &out, FramePacer const &pacer)
+{
+    out << "frames=" << pacer.frames << " overruns=" << pacer.overruns
+        << " worst_jitter_us=" << pacer.worstJitter * 1e6 << "\n";
+
+    for (int i = 0; i < FramePacer::BUCKETS; ++i)
+    {
+        if (!pacer.histogram[i])
+            continue;
+        out << (i == FramePacer::BUCKETS - 1 ? ">=" : "") << i * FramePacer::BUCKET_US << "us "
+            << pacer.histogram[i] << "\n";
+    }
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+// Paces a loop to a fixed rate against absolute deadlines on the monotonic
+// clock, so rounding in one frame never turns into drift. Wait sleeps until
+// shortly before the deadline and spins the rest, which the OS sleep alone
+// cannot hit precisely. After an overrun of a whole period or more the
+// schedule restarts from now instead of rushing frames to catch up.
+class FramePacer
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    // Histogram of |frame interval - period| in BUCKET_US wide buckets; the
+    // last bucket also counts everything larger
+    static constexpr int BUCKETS = 40;
+    static constexpr int BUCKET_US = 100;
+
+    // By default wake this long before the deadline and spin the remainder
+    static constexpr std::chrono::microseconds DEFAULT_SPIN{1000};
+
+    // spin = 0 sleeps only: cheaper, for loops that measure real elapsed
+    // time anyway and only need the average rate
+    explicit FramePacer(double hz, std::chrono::microseconds spin = DEFAULT_SPIN);
+
+    // Block until the next deadline
+    void Wait();
+
+    // Start the schedule over from now and clear the statistics
+    void Reset();
+
+    double Hz() const { return 1.0 / std::chrono::duration<double>(period).count(); }
+
+    uint64_t histogram[BUCKETS] = {};
+    uint64_t frames = 0;
+    uint64_t overruns = 0;    // deadlines missed by a whole period or more
+    double worstJitter = 0.0; // seconds
+
+private:
+    Clock::duration period;
+    Clock::duration spin;
+    Clock::time_point deadline;
+    Clock::time_point lastWake;
+};
+
+// One line per non-empty bucket, plus totals
+void PrintPacing(std::ostream &out, FramePacer const &pacer);
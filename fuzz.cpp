@@ -0,0 +1,30 @@
+// chip8-fuzz: write a random ROM (see fuzz_rom.hpp), e.g. to feed chip8-aot
+// or chip8-bisect.
+//
+//   chip8-fuzz 17 out.ch8 [random|smc]
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include "fuzz_rom.hpp"
+
+int main(int argc, char **argv)
+{
+    FuzzKind kind = FuzzKind::Random;
+    if (argc < 3 || (argc > 3 && !ParseFuzzKind(argv[3], kind)))
+    {
+        std::cerr << "usage: chip8-fuzz seed out.ch8 [random|smc]" << std::endl;
+        return 1;
+    }
+
+    uint32_t seed = static_cast<uint32_t>(std::strtoul(argv[1], nullptr, 0));
+    std::vector<uint8_t> rom = FuzzRom(seed, kind);
+
+    std::ofstream out(argv[2], std::ios::binary);
+    out.write(reinterpret_cast<char const *>(rom.data()), static_cast<std::streamsize>(rom.size()));
+    if (!out)
+    {
+        std::cerr << "Failed to write " << argv[2] << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,147 @@
+#include "fuzz_rom.hpp"
+#include <cstring>
+#include <random>
+
+static const uint8_t FX_OPS[] = {0x07, 0x0A, 0x15, 0x18, 0x1E, 0x29, 0x33, 0x55, 0x65};
+static const uint8_t ALU_OPS[] = {0x0, 0x1, 0x2, 0x3, 0x4, 0x5, 0x6, 0x7, 0xE};
+
+// Any opcode, nudged as described in fuzz_rom.hpp
+static uint16_t RandomOp(std::mt19937 &random, uint16_t const (&labels)[8])
+{
+    uint16_t op = static_cast<uint16_t>(random());
+    uint16_t x = op & 0x0F00;
+    uint16_t target = labels[random() % 8];
+
+    switch (op >> 12)
+    {
+    case 0x0:
+        // Keep a few SYS faults, the rest clear, return or load
+        switch (random() % 16)
+        {
+        case 0:
+            break;
+        case 1:
+            op = 0x00E0;
+            break;
+        case 2:
+            op = 0x00EE;
+            break;
+        default:
+            op = 0x6000 | (op & 0x0FFF);
+            break;
+        }
+        break;
+    case 0x1:
+    case 0x2:
+        op = (op & 0xF000) | target;
+        break;
+    case 0xB:
+        // V0 is added on top, up to 255 bytes further
+        op = 0xB000 | (0x200 + (target - 0x200) / 2);
+        break;
+    case 0x5:
+    case 0x9:
+        op &= 0xFFF0;
+        break;
+    case 0xA:
+        // Often just below the top, so that Fx33/Fx55/Fx65 and Dxyn wrap
+        if (random() % 4 == 0)
+            op |= 0x0FF0;
+        break;
+    case 0x8:
+        op = (op & 0xFFF0) | ALU_OPS[random() % sizeof(ALU_OPS)];
+        break;
+    case 0xE:
+        op = 0xE000 | x | (random() % 2 ? 0x9E : 0xA1);
+        break;
+    case 0xF:
+        op = 0xF000 | x | FX_OPS[random() % sizeof(FX_OPS)];
+        break;
+    }
+    return op;
+}
+
+// Register arithmetic only: 6xkk, 7xkk, 8xy_ or Cxkk
+static uint16_t AluOp(std::mt19937 &random)
+{
+    uint16_t op = static_cast<uint16_t>(random()) & 0x0FFF;
+    switch (random() % 4)
+    {
+    case 0:
+        return 0x6000 | op;
+    case 1:
+        return 0x7000 | op;
+    case 2:
+        return 0x8000 | (op & 0x0FF0) | ALU_OPS[random() % sizeof(ALU_OPS)];
+    default:
+        return 0xC000 | op;
+    }
+}
+
+std::vector<uint8_t> FuzzRom(uint32_t seed, FuzzKind kind, size_t instructions)
+{
+    std::mt19937 random(seed);
+
+    // Jumps and calls go to a handful of labels, so that code around them
+    // gets hot
+    uint16_t labels[8];
+    for (uint16_t &label : labels)
+        label = static_cast<uint16_t>(0x200 + 2 * (random() % instructions));
+
+    std::vector<uint16_t> ops(instructions);
+    for (uint16_t &op : ops)
+        op = RandomOp(random, labels);
+
+    // A loop that rewrites itself or the subroutine it calls on every pass,
+    // so stores land on code that is hot (and compiled) by then:
+    //
+    //   0x200  5 ALU ops; Vx += odd kk; Annn; Fx33 or Fx55; call 0x218;
+    //          3xkk; jp 0x200; jp to a label, the way out into the random code
+    //   0x218  6 ALU ops; ret
+    //
+    // Vx changes on every pass, so the bytes stored do too.
+    const size_t LOOP = 19;
+    if (kind == FuzzKind::SelfModifying && instructions > LOOP)
+    {
+        for (size_t i : {0, 1, 2, 3, 4, 12, 13, 14, 15, 16, 17})
+            ops[i] = AluOp(random);
+
+        uint16_t x = static_cast<uint16_t>((random() % 4) << 8);
+        ops[5] = static_cast<uint16_t>(0x7001 | x | (random() & 0xFE));
+        ops[6] = static_cast<uint16_t>(0xA000 | (0x200 + random() % (2 * LOOP)));
+        ops[7] = 0xF000 | x | (random() % 2 ? 0x33 : 0x55);
+        ops[8] = 0x2218;
+        ops[9] = static_cast<uint16_t>(0x3000 | (random() & 0x0FFF));
+        ops[10] = 0x1200;
+        ops[11] = 0x1000 | labels[random() % 8];
+        ops[18] = 0x00EE;
+    }
+
+    // Code that runs off the end starts over instead of stopping
+    ops.back() = 0x1200;
+
+    std::vector<uint8_t> rom;
+    rom.reserve(instructions * 2);
+    for (uint16_t op : ops)
+    {
+        rom.push_back(static_cast<uint8_t>(op >> 8));
+        rom.push_back(static_cast<uint8_t>(op));
+    }
+    return rom;
+}
+
+bool ParseFuzzKind(char const *name, FuzzKind &kind)
+{
+    if (std::strcmp(name, "random") == 0)
+        kind = FuzzKind::Random;
+    else if (std::strcmp(name, "smc") == 0)
+        kind = FuzzKind::SelfModifying;
+    else
+        return false;
+    return true;
+}
+
+char const *FuzzKindName(FuzzKind kind)
+{
+    return kind == FuzzKind::SelfModifying ? "smc" : "random";
+}
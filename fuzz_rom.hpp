@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Random ROMs for differential testing of the cores (see chip8-differential).
+//
+// Opcodes are drawn from a generator seeded with `seed` and nudged so the
+// program keeps running: jumps and calls land on its own instructions, and
+// most 0nnn and undefined Exkk/Fxkk become valid opcodes. I is left free to
+// point anywhere, so Fx1E/Fx33/Fx55/Fx65 wrap around the end of memory.
+enum class FuzzKind : uint8_t
+{
+    Random,
+    // Starts with a hot loop whose Fx33 or Fx55 rewrites its own code or
+    // the subroutine it calls, compiled by then on the Jit and Aot cores
+    SelfModifying,
+};
+
+std::vector<uint8_t> FuzzRom(uint32_t seed, FuzzKind kind, size_t instructions = 256);
+
+bool ParseFuzzKind(char const *name, FuzzKind &kind);
+char const *FuzzKindName(FuzzKind kind);
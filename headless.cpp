@@ -0,0 +1,222 @@
+// chip8-headless: run a ROM without a window, as fast as possible.
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include "batch.hpp"
+#include "runner.hpp"
+
+static void Usage()
+{
+    std::cerr << "usage: chip8-headless ROM [options]\n"
+                 "       chip8-headless --batch MANIFEST [options]\n"
+                 "  --frames N      60 Hz frames to run (default 600)\n"
+                 "  --ips N         instructions per second (default 700)\n"
+                 "  --core NAME     table, threaded, jit or aot (default table)\n"
+                 "  --aot FILE      chip8-aot output built as a shared library,\n"
+                 "                  for --core aot\n"
+                 "  --input FILE    input script, lines of `frame key down|up`\n"
+                 "  --seed N        random number seed (default 0)\n"
+                 "  --record FILE   save the run as a movie\n"
+                 "  --replay FILE   replay a movie instead; fails if the final\n"
+                 "                  state differs from the recording\n"
+                 "  --keyframes N   frames between movie keyframes (default 600)\n"
+                 "  --verify FILE   replay a movie's keyframe segments in parallel\n"
+                 "                  (--threads) and report the first that diverges\n"
+                 "  --screen FILE   write the final screen as a PBM image\n"
+                 "  --trace         print the trace ring at the end\n"
+                 "  --batch FILE    run every `rom [input|-] [frames]` line of FILE,\n"
+                 "                  one JSON line per job\n"
+                 "  --threads N     batch worker threads (default: all cores)\n"
+                 "  --scaling       batch throughput at 1..N threads instead\n"
+                 "  --lanes N       run N copies in lockstep (SIMD lanes); prints\n"
+                 "                  lane 0's hash and the total rate\n";
+}
+
+// Final screen as a plain PBM (P1) image
+static bool WriteScreen(char const *path, Chip8 const &chip)
+{
+    std::ofstream out(path);
+    if (!out)
+        return false;
+
+    out << "P1\n"
+        << chip.DISPLAY_WIDTH << " " << chip.DISPLAY_HEIGHT << "\n";
+    for (unsigned y = 0; y < chip.DISPLAY_HEIGHT; ++y)
+    {
+        for (unsigned x = 0; x < chip.DISPLAY_WIDTH; ++x)
+            out << ((chip.screen[y] >> (63 - x)) & 1 ? '1' : '0');
+        out << '\n';
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    RunOptions options;
+    char const *screenPath = nullptr;
+    bool printTrace = false;
+    char const *manifest = nullptr;
+    unsigned threads = std::thread::hardware_concurrency();
+    bool scaling = false;
+    size_t lanes = 0;
+    char const *recordPath = nullptr;
+    char const *replayPath = nullptr;
+    char const *verifyPath = nullptr;
+    std::string error;
+
+    for (int i = 1; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (arg == "--frames" && hasValue)
+            options.frames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--ips" && hasValue)
+            options.ips = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--core" && hasValue)
+        {
+            if (!ParseCore(argv[++i], options.core))
+            {
+                std::cerr << "unknown core: " << argv[i] << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--aot" && hasValue)
+        {
+            if (!LoadAotProgram(argv[++i], options.aot, error))
+            {
+                std::cerr << error << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--input" && hasValue)
+        {
+            if (!LoadInputScript(argv[++i], options.input, error))
+            {
+                std::cerr << error << std::endl;
+                return 2;
+            }
+        }
+        else if (arg == "--seed" && hasValue)
+            options.seed = std::strtoull(argv[++i], nullptr, 10);
+        else if (arg == "--record" && hasValue)
+            recordPath = argv[++i];
+        else if (arg == "--replay" && hasValue)
+            replayPath = argv[++i];
+        else if (arg == "--keyframes" && hasValue)
+            options.keyframeFrames = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--verify" && hasValue)
+            verifyPath = argv[++i];
+        else if (arg == "--screen" && hasValue)
+            screenPath = argv[++i];
+        else if (arg == "--trace")
+            printTrace = true;
+        else if (arg == "--batch" && hasValue)
+            manifest = argv[++i];
+        else if (arg == "--threads" && hasValue)
+            threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        else if (arg == "--scaling")
+            scaling = true;
+        else if (arg == "--lanes" && hasValue)
+            lanes = std::strtoul(argv[++i], nullptr, 10);
+        else if (arg[0] != '-' && options.rom.empty())
+            options.rom = arg;
+        else
+        {
+            Usage();
+            return 2;
+        }
+    }
+
+    if (threads == 0)
+        threads = 1;
+
+    // Every job runs at this speed; at 0 the Scheduler never reaches a tick
+    if (options.ips == 0 || (!manifest && options.rom.empty()))
+    {
+        Usage();
+        return 2;
+    }
+
+    if (manifest)
+    {
+        std::vector<RunOptions> jobs;
+        if (!LoadManifest(manifest, options, jobs, error))
+        {
+            std::cerr << error << std::endl;
+            return 2;
+        }
+
+        if (scaling)
+        {
+            RunScaling(jobs, threads, std::cout);
+            return 0;
+        }
+        return RunBatch(jobs, threads, std::cout) ? 0 : 1;
+    }
+
+    Movie movie;
+    if (verifyPath)
+    {
+        if (!ReadMovie(verifyPath, movie, error))
+        {
+            std::cerr << error << std::endl;
+            return 2;
+        }
+        return VerifyMovie(options, movie, threads, std::cout) ? 0 : 1;
+    }
+
+    auto chip = std::make_unique<Chip8>();
+    RunResult result;
+    bool ok;
+    if (replayPath)
+        ok = ReadMovie(replayPath, movie, error) && RunMovie(options, movie, *chip, result, error);
+    else if (lanes > 0)
+        ok = RunRomLanes(options, lanes, *chip, result, error);
+    else
+        ok = RunRom(options, *chip, result, error, recordPath ? &movie : nullptr);
+    if (ok && recordPath && !replayPath)
+        ok = WriteMovie(recordPath, movie, error);
+    if (!ok)
+    {
+        std::cerr << error << std::endl;
+        return 1;
+    }
+
+    if (printTrace)
+    {
+        uint64_t cursor = 0;
+        PrintTrace(std::cout, chip->trace, cursor);
+    }
+
+    if (screenPath && !WriteScreen(screenPath, *chip))
+    {
+        std::cerr << "cannot write " << screenPath << std::endl;
+        return 1;
+    }
+
+    char hash[17];
+    snprintf(hash, sizeof(hash), "%016llx", static_cast<unsigned long long>(result.hash));
+
+    double mips = result.seconds > 0 ? result.instructions / result.seconds / 1e6 : 0.0;
+    if (replayPath)
+    {
+        bool match = result.hash == movie.finalHash;
+        std::cout << "instructions=" << result.instructions
+                  << " seconds=" << result.seconds
+                  << " mips=" << mips
+                  << " hash=" << hash
+                  << " match=" << (match ? "yes" : "no") << std::endl;
+        return match ? 0 : 1;
+    }
+
+    std::cout << "frames=" << options.frames
+              << " instructions=" << result.instructions
+              << " seconds=" << result.seconds
+              << " mips=" << mips
+              << " hash=" << hash << std::endl;
+    return 0;
+}
@@ -0,0 +1,475 @@
+#include "jit.hpp"
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+#if defined(__x86_64__) && defined(__unix__)
+#include <sys/mman.h>
+#include <unistd.h>
+#define CHIP8_JIT_X64 1
+#endif
+
+#ifdef CHIP8_JIT_X64
+
+// Byte offset of a Chip8 member, used as a disp32 off rbx
+static int32_t Offset(Chip8 const *chip, void const *member)
+{
+    return static_cast<int32_t>(static_cast<char const *>(member) - reinterpret_cast<char const *>(chip));
+}
+
+// Minimal x86-64 encoder for the handful of forms the translator needs.
+// The Chip8 pointer lives in rbx for the whole block.
+struct Emitter
+{
+    std::vector<uint8_t> buf;
+
+    void Byte(uint8_t b) { buf.push_back(b); }
+
+    void Imm16(uint16_t v)
+    {
+        Byte(v & 0xff);
+        Byte(v >> 8);
+    }
+
+    void Imm32(uint32_t v)
+    {
+        for (int i = 0; i < 4; ++i)
+            Byte((v >> (8 * i)) & 0xff);
+    }
+
+    void Imm64(uint64_t v)
+    {
+        for (int i = 0; i < 8; ++i)
+            Byte((v >> (8 * i)) & 0xff);
+    }
+
+    // <op> [rbx + disp32] with the given reg field
+    void Mem(uint8_t reg, int32_t disp)
+    {
+        Byte(0x80 | (reg << 3) | 3);
+        Imm32(static_cast<uint32_t>(disp));
+    }
+
+    // push rbx; push r12; sub rsp, 8; mov rbx, rdi; mov r12d, esi
+    // The extra 8 bytes keep rsp 16-byte aligned for handler calls.
+    void Prologue()
+    {
+        Byte(0x53);
+        Byte(0x41), Byte(0x54);
+        Byte(0x48), Byte(0x83), Byte(0xec), Byte(0x08);
+        Byte(0x48), Byte(0x89), Byte(0xfb);
+        Byte(0x41), Byte(0x89), Byte(0xf4);
+    }
+
+    // mov eax, count; add rsp, 8; pop r12; pop rbx; ret
+    void Epilogue(uint32_t count)
+    {
+        Byte(0xb8), Imm32(count);
+        Byte(0x48), Byte(0x83), Byte(0xc4), Byte(0x08);
+        Byte(0x41), Byte(0x5c);
+        Byte(0x5b);
+        Byte(0xc3);
+    }
+
+    // cmp r12d, count; jle <exit>. Returns the offset of the rel32 to patch.
+    size_t ExitIfBudgetSpent(uint8_t count)
+    {
+        Byte(0x41), Byte(0x83), Byte(0xfc), Byte(count);
+        Byte(0x0f), Byte(0x8e), Imm32(0);
+        return buf.size() - 4;
+    }
+
+    // mov eax, r12d; add rsp, 8; pop r12; pop rbx; ret
+    void BudgetExit()
+    {
+        Byte(0x44), Byte(0x89), Byte(0xe0);
+        Byte(0x48), Byte(0x83), Byte(0xc4), Byte(0x08);
+        Byte(0x41), Byte(0x5c);
+        Byte(0x5b);
+        Byte(0xc3);
+    }
+
+    // Point the jump whose rel32 is at `at` to the current position
+    void Patch(size_t at)
+    {
+        uint32_t rel = static_cast<uint32_t>(buf.size() - (at + 4));
+        for (int i = 0; i < 4; ++i)
+            buf[at + i] = (rel >> (8 * i)) & 0xff;
+    }
+
+    // mov byte [rbx + d], imm8
+    void StoreImm8(int32_t d, uint8_t v)
+    {
+        Byte(0xc6), Mem(0, d), Byte(v);
+    }
+
+    // add byte [rbx + d], imm8
+    void AddImm8(int32_t d, uint8_t v)
+    {
+        Byte(0x80), Mem(0, d), Byte(v);
+    }
+
+    // mov word [rbx + d], imm16
+    void StoreImm16(int32_t d, uint16_t v)
+    {
+        Byte(0x66), Byte(0xc7), Mem(0, d), Imm16(v);
+    }
+
+    // add qword [rbx + d], imm32
+    void AddImm32To64(int32_t d, uint32_t v)
+    {
+        Byte(0x48), Byte(0x81), Mem(0, d), Imm32(v);
+    }
+
+    // mov al, [rbx + d]
+    void LoadAl(int32_t d)
+    {
+        Byte(0x8a), Mem(0, d);
+    }
+
+    // mov [rbx + d], al
+    void StoreAl(int32_t d)
+    {
+        Byte(0x88), Mem(0, d);
+    }
+
+    // mov [rbx + d], cl
+    void StoreCl(int32_t d)
+    {
+        Byte(0x88), Mem(1, d);
+    }
+
+    // <alu> [rbx + d], al  (0x08 or, 0x20 and, 0x30 xor)
+    void AluStoreAl(uint8_t opc, int32_t d)
+    {
+        Byte(opc), Mem(0, d);
+    }
+
+    // <alu> al, [rbx + d]  (0x02 add, 0x2a sub)
+    void AluLoadAl(uint8_t opc, int32_t d)
+    {
+        Byte(opc), Mem(0, d);
+    }
+
+    // setc cl / setnc cl
+    void SetCarry(bool inverted)
+    {
+        Byte(0x0f), Byte(inverted ? 0x93 : 0x92), Byte(0xc1);
+    }
+
+    // movzx eax, byte [rbx + d]; add word [rbx + i], ax
+    void AddByteToWord(int32_t i, int32_t d)
+    {
+        Byte(0x0f), Byte(0xb6), Mem(0, d);
+        Byte(0x66), Byte(0x01), Mem(0, i);
+    }
+
+    // mov rdi, rbx; mov rsi, arg; mov rax, fn; call rax
+    void Call(void const *fn, void const *arg)
+    {
+        Byte(0x48), Byte(0x89), Byte(0xdf);
+        Byte(0x48), Byte(0xbe), Imm64(reinterpret_cast<uint64_t>(arg));
+        Byte(0x48), Byte(0xb8), Imm64(reinterpret_cast<uint64_t>(fn));
+        Byte(0xff), Byte(0xd0);
+    }
+};
+
+Jit::Jit(Chip8 *chip) : chip(chip)
+{
+    void *mem = mmap(nullptr, CODE_SIZE, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mem != MAP_FAILED)
+        code = static_cast<uint8_t *>(mem);
+
+    Flush();
+}
+
+Jit::~Jit()
+{
+    if (code)
+        munmap(code, CODE_SIZE);
+}
+
+void Jit::Flush()
+{
+    std::fill(std::begin(hits), std::end(hits), 0);
+    std::fill(std::begin(evictions), std::end(evictions), 0);
+    std::fill(std::begin(blockAt), std::end(blockAt), NOT_COMPILED);
+    blocks.clear();
+    for (auto &page : pageBlocks)
+        page.clear();
+    operands.clear();
+    codeUsed = 0;
+}
+
+int Jit::Run(int budget)
+{
+    uint16_t pc = chip->pc;
+    if (!code || pc >= 4096)
+        return 0;
+
+    int32_t b = blockAt[pc];
+    if (b == UNCOMPILABLE || b == SELF_MODIFYING)
+        return 0;
+    if (b == NOT_COMPILED)
+    {
+        if (++hits[pc] < HOT_THRESHOLD)
+            return 0;
+        b = Compile(pc);
+        if (b < 0)
+            return 0;
+    }
+
+    if (budget <= 0)
+        return 0;
+
+    Block const &block = blocks[b];
+    uint64_t entry = chip->cycles;
+    int count = block.fn(chip, budget);
+    if (count < block.count)
+    {
+        // Stopped at the budget partway through: leave pc, opcode and
+        // cycles as Fetch would have after the last instruction that ran
+        chip->cycles = entry + count;
+        chip->pc = static_cast<uint16_t>(block.start + 2 * count);
+        chip->opcode = chip->decoded[chip->pc - 2].opcode;
+    }
+    return count;
+}
+
+void Jit::Invalidate(uint32_t addr, uint32_t len, bool byProgram)
+{
+    uint32_t first = addr > 0 ? addr - 1 : 0;
+    uint32_t last = std::min<uint32_t>(addr + len, 4096);
+    if (first >= last)
+        return;
+
+    for (uint32_t a = first; a < last; ++a)
+    {
+        if (blockAt[a] == UNCOMPILABLE)
+            blockAt[a] = NOT_COMPILED;
+    }
+
+    for (uint32_t page = first >> PAGE_SHIFT; page <= (last - 1) >> PAGE_SHIFT; ++page)
+    {
+        for (int32_t b : pageBlocks[page])
+        {
+            Block const &block = blocks[b];
+            if (block.start < last && block.end > first && blockAt[block.start] == b)
+            {
+                // Code that keeps rewriting itself would only be recompiled
+                // over and over
+                bool thrashing = byProgram && ++evictions[block.start] >= MAX_EVICTIONS;
+                blockAt[block.start] = thrashing ? SELF_MODIFYING : NOT_COMPILED;
+                hits[block.start] = 0;
+            }
+        }
+    }
+}
+
+int32_t Jit::Compile(uint16_t start)
+{
+    Emitter e;
+    e.Prologue();
+
+    int32_t reg = Offset(chip, chip->registers);
+    int32_t vf = reg + 0xf;
+    int32_t ir = Offset(chip, &chip->IR);
+    int32_t pcOff = Offset(chip, &chip->pc);
+    int32_t opcodeOff = Offset(chip, &chip->opcode);
+    int32_t delay = Offset(chip, &chip->d_timer);
+    int32_t cyclesOff = Offset(chip, &chip->cycles);
+
+    uint16_t addr = start;
+    uint16_t count = 0;
+    bool lastNative = false;
+    uint16_t lastOpcode = 0;
+
+    // Instructions whose cycles have not been added to chip->cycles yet
+    uint32_t pending = 0;
+
+    // Jumps taken when the budget runs out before an instruction; that is
+    // always exactly `budget` instructions in, and Run fixes up the state
+    std::vector<size_t> exits;
+
+    while (count < MAX_BLOCK_INSTRS)
+    {
+        // Same conditions under which Fetch stops execution
+        if (addr < chip->START_ADRESS || addr >= 4095)
+            break;
+        if (chip->decoded[addr].op == OP_UNDECODED)
+            chip->Decode(addr);
+
+        Instr const &in = chip->decoded[addr];
+        if (in.opcode == 0 || in.op == OP_NULL)
+            break;
+
+        if (count > 0)
+            exits.push_back(e.ExitIfBudgetSpent(static_cast<uint8_t>(count)));
+
+        int32_t x = reg + in.x;
+        int32_t y = reg + in.y;
+        lastNative = true;
+        ++pending;
+
+        switch (in.op)
+        {
+        case OP_6xkk:
+            e.StoreImm8(x, in.kk);
+            break;
+        case OP_7xkk:
+            e.AddImm8(x, in.kk);
+            break;
+        case OP_8xy0:
+            e.LoadAl(y);
+            e.StoreAl(x);
+            break;
+        case OP_8xy1:
+            e.LoadAl(y);
+            e.AluStoreAl(0x08, x);
+            break;
+        case OP_8xy2:
+            e.LoadAl(y);
+            e.AluStoreAl(0x20, x);
+            break;
+        case OP_8xy3:
+            e.LoadAl(y);
+            e.AluStoreAl(0x30, x);
+            break;
+        case OP_8xy4:
+            // Vx first, then VF, so VF wins when x == F
+            e.LoadAl(x);
+            e.AluLoadAl(0x02, y);
+            e.SetCarry(false);
+            e.StoreAl(x);
+            e.StoreCl(vf);
+            break;
+        case OP_8xy5:
+            e.LoadAl(x);
+            e.AluLoadAl(0x2a, y);
+            e.SetCarry(true);
+            e.StoreAl(x);
+            e.StoreCl(vf);
+            break;
+        case OP_Annn:
+            e.StoreImm16(ir, in.nnn);
+            break;
+        case OP_Fx07:
+            e.LoadAl(delay);
+            e.StoreAl(x);
+            break;
+        case OP_Fx15:
+            e.LoadAl(x);
+            e.StoreAl(delay);
+            break;
+        case OP_Fx1E:
+            e.AddByteToWord(ir, x);
+            break;
+        default:
+            // Hand the instruction to the interpreter with pc, opcode and
+            // cycles exactly as Fetch would have left them
+            operands.push_back(in);
+            e.AddImm32To64(cyclesOff, pending);
+            pending = 0;
+            e.StoreImm16(pcOff, addr + 2);
+            e.StoreImm16(opcodeOff, in.opcode);
+            e.Call(reinterpret_cast<void const *>(Chip8::Handler(in.op)), &operands.back());
+            lastNative = false;
+            break;
+        }
+
+        lastOpcode = in.opcode;
+        addr += 2;
+        ++count;
+
+        if (EndsBlock(in.op))
+            break;
+    }
+
+    if (count == 0)
+    {
+        blockAt[start] = UNCOMPILABLE;
+        return UNCOMPILABLE;
+    }
+
+    if (pending > 0)
+        e.AddImm32To64(cyclesOff, pending);
+    if (lastNative)
+    {
+        e.StoreImm16(pcOff, addr);
+        e.StoreImm16(opcodeOff, lastOpcode);
+    }
+    e.Epilogue(count);
+
+    if (!exits.empty())
+    {
+        for (size_t jump : exits)
+            e.Patch(jump);
+        e.BudgetExit();
+    }
+
+    if (codeUsed + e.buf.size() > CODE_SIZE)
+    {
+        // Out of space: start over, this block is compiled again once hot
+        Flush();
+        return NOT_COMPILED;
+    }
+
+    // Only the pages being written lose execute permission
+    uint8_t *dst = code + codeUsed;
+    size_t pageSize = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    size_t first = codeUsed / pageSize * pageSize;
+    size_t length = codeUsed + e.buf.size() - first;
+
+    mprotect(code + first, length, PROT_READ | PROT_WRITE);
+    std::memcpy(dst, e.buf.data(), e.buf.size());
+    mprotect(code + first, length, PROT_READ | PROT_EXEC);
+    codeUsed += e.buf.size();
+
+    Block block;
+    block.fn = reinterpret_cast<int (*)(Chip8 *, int)>(dst);
+    block.start = start;
+    block.end = addr;
+    block.count = count;
+
+    int32_t index = static_cast<int32_t>(blocks.size());
+    blocks.push_back(block);
+    blockAt[start] = index;
+    for (uint32_t page = start >> PAGE_SHIFT; page <= (addr - 1u) >> PAGE_SHIFT; ++page)
+        pageBlocks[page].push_back(index);
+
+    WritePerfMap(block, e.buf.size());
+    return index;
+}
+
+// Let `perf report` attribute samples in generated code to guest blocks.
+// The map belongs to the process; every Jit (batch mode runs several at
+// once) appends to the same handle.
+void Jit::WritePerfMap(Block const &block, size_t size)
+{
+    static std::mutex lock;
+    static FILE *perfMap = []
+    {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", static_cast<int>(getpid()));
+        return fopen(path, "a");
+    }();
+    if (!perfMap)
+        return;
+
+    std::lock_guard<std::mutex> guard(lock);
+    fprintf(perfMap, "%lx %zx chip8_block_%03x_%03x\n",
+            reinterpret_cast<unsigned long>(block.fn), size, block.start, block.end);
+    fflush(perfMap);
+}
+
+#else
+
+Jit::Jit(Chip8 *chip) : chip(chip) {}
+Jit::~Jit() {}
+int Jit::Run(int) { return 0; }
+void Jit::Invalidate(uint32_t, uint32_t, bool) {}
+void Jit::Flush() {}
+int32_t Jit::Compile(uint16_t) { return UNCOMPILABLE; }
+void Jit::WritePerfMap(Block const &, size_t) {}
+
+#endif
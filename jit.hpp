@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "chip8.hpp"
+
+// True for instructions that end a basic block: anything that writes pc,
+// may skip, draws, waits for a key or writes memory.
+inline bool EndsBlock(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_NULL:
+    case OP_00EE:
+    case OP_1nnn:
+    case OP_2nnn:
+    case OP_3xkk:
+    case OP_4xkk:
+    case OP_5xy0:
+    case OP_9xy0:
+    case OP_Bnnn:
+    case OP_Dxyn:
+    case OP_Ex9E:
+    case OP_ExA1:
+    case OP_Fx0A:
+    case OP_Fx33:
+    case OP_Fx55:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// x86-64 dynamic recompiler for CHIP-8 basic blocks.
+//
+// The interpreter calls Run at every block entry. Blocks that are entered
+// often enough are translated to native code; simple ALU/load instructions
+// are emitted inline and everything else calls back into the interpreter
+// handler. On other hosts Run always returns 0 and the interpreter does
+// all the work.
+class Jit
+{
+public:
+    explicit Jit(Chip8 *chip);
+    ~Jit();
+
+    // Run the block starting at chip->pc if it is compiled, leaving it
+    // early once budget instructions have run. Returns the number of
+    // instructions executed, 0 if none.
+    int Run(int budget);
+
+    // Drop blocks overlapping memory[addr, addr + len). Only stores by the
+    // program count towards marking a block SELF_MODIFYING; state restores
+    // (run-ahead, rewind) just drop it.
+    void Invalidate(uint32_t addr, uint32_t len, bool byProgram);
+
+    // Drop every block and reset the hit counters
+    void Flush();
+
+private:
+    static constexpr int HOT_THRESHOLD = 16;
+    static constexpr int MAX_BLOCK_INSTRS = 32;
+    static constexpr int PAGE_SHIFT = 6;
+    static constexpr int MAX_EVICTIONS = 4;
+    static constexpr size_t CODE_SIZE = 1 << 20;
+
+    // blockAt values that are not block indices
+    static constexpr int32_t NOT_COMPILED = -1;
+    static constexpr int32_t UNCOMPILABLE = -2;
+    static constexpr int32_t SELF_MODIFYING = -3; // rewritten too often, stays interpreted
+
+    struct Block
+    {
+        int (*fn)(Chip8 *, int budget);
+        uint16_t start;
+        uint16_t end; // one past the last byte
+        uint16_t count;
+    };
+
+    int32_t Compile(uint16_t start);
+    void WritePerfMap(Block const &block, size_t size);
+
+    Chip8 *chip;
+
+    uint8_t *code = nullptr;
+    size_t codeUsed = 0;
+
+    uint16_t hits[4096];
+    uint8_t evictions[4096];
+    int32_t blockAt[4096];
+    std::vector<Block> blocks;
+    std::vector<int32_t> pageBlocks[4096 >> PAGE_SHIFT];
+
+    // Operands handed to interpreter callbacks; stable until Flush
+    std::deque<Instr> operands;
+};
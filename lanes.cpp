@@ -0,0 +1,522 @@
+#include "lanes.hpp"
+#include <algorithm>
+#include "scheduler.hpp"
+
+// The lane loops below are written so the compiler vectorizes them. On
+// x86-64 with GCC each is also built for AVX2 and picked at load time.
+#if defined(__GNUC__) && !defined(__clang__) && defined(__x86_64__) && defined(__ELF__)
+#define LANE_KERNEL __attribute__((target_clones("avx2", "default")))
+#else
+#define LANE_KERNEL
+#endif
+
+// Masks hold 0x00 or 0xFF per lane.
+
+// Fetch one opcode per running lane with the same stop conditions as
+// Chip8::Fetch. Returns how many lanes have an instruction to run.
+LANE_KERNEL static size_t Fetch(uint8_t const *memory, uint16_t *pc, uint8_t *running, uint8_t *pending,
+                                uint16_t *opcode, size_t n)
+{
+    // Common case: every lane running at the same pc, so the opcode bytes
+    // of all lanes are two contiguous rows of memory
+    uint16_t at = pc[0];
+    uint8_t same = 0xFF;
+    for (size_t l = 0; l < n; ++l)
+        same &= running[l] & (pc[l] == at ? 0xFF : 0x00);
+
+    if (same && at >= 0x200 && at < Chip8Lanes::MEMORY_SIZE - 1)
+    {
+        uint8_t const *hi = memory + at * n;
+        uint8_t const *lo = hi + n;
+        for (size_t l = 0; l < n; ++l)
+            opcode[l] = (hi[l] << 8u) | lo[l];
+        std::fill_n(pc, n, at + 2);
+
+        size_t live = 0;
+        for (size_t l = 0; l < n; ++l)
+        {
+            running[l] = opcode[l] ? 0xFF : 0x00;
+            live += opcode[l] != 0;
+        }
+        std::copy_n(running, n, pending);
+        return live;
+    }
+
+    size_t live = 0;
+    for (size_t l = 0; l < n; ++l)
+    {
+        at = pc[l];
+        bool inside = running[l] && at >= 0x200 && at < Chip8Lanes::MEMORY_SIZE - 1;
+        size_t from = inside ? at : 0x200;
+        uint16_t op = (memory[from * n + l] << 8u) | memory[(from + 1) * n + l];
+        op = inside ? op : 0;
+
+        pc[l] = inside ? at + 2 : at;
+        running[l] = op ? 0xFF : 0x00;
+        pending[l] = running[l];
+        opcode[l] = op;
+        live += op != 0;
+    }
+    return live;
+}
+
+LANE_KERNEL static void GroupMask(uint16_t const *opcode, uint16_t value, uint8_t *pending, uint8_t *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        uint8_t m = pending[l] & (opcode[l] == value ? 0xFF : 0x00);
+        mask[l] = m;
+        pending[l] &= ~m;
+    }
+}
+
+LANE_KERNEL static void SetConst(uint8_t *dst, uint8_t value, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        dst[l] = mask[l] ? value : dst[l];
+}
+
+LANE_KERNEL static void AddConst(uint8_t *dst, uint8_t value, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        dst[l] += value & mask[l];
+}
+
+LANE_KERNEL static void Move(uint8_t *dst, uint8_t const *src, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        dst[l] = mask[l] ? src[l] : dst[l];
+}
+
+LANE_KERNEL static void Or(uint8_t *dst, uint8_t const *src, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        dst[l] |= src[l] & mask[l];
+}
+
+LANE_KERNEL static void And(uint8_t *dst, uint8_t const *src, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        dst[l] &= src[l] | ~mask[l];
+}
+
+LANE_KERNEL static void Xor(uint8_t *dst, uint8_t const *src, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        dst[l] ^= src[l] & mask[l];
+}
+
+// The flag kernels read and write each lane in the same order as the scalar
+// handlers, so x, y and F may be the same register.
+
+// 8xy4
+LANE_KERNEL static void AddCarry(uint8_t *vx, uint8_t const *vy, uint8_t *vf, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        unsigned sum = vx[l] + vy[l];
+        vx[l] = mask[l] ? static_cast<uint8_t>(sum) : vx[l];
+        vf[l] = mask[l] ? static_cast<uint8_t>(sum > 0xFF) : vf[l];
+    }
+}
+
+// 8xy5
+LANE_KERNEL static void Sub(uint8_t *vx, uint8_t const *vy, uint8_t *vf, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        uint8_t a = vx[l];
+        uint8_t b = vy[l];
+        vx[l] = mask[l] ? static_cast<uint8_t>(a - b) : a;
+        vf[l] = mask[l] ? static_cast<uint8_t>(a >= b) : vf[l];
+    }
+}
+
+// 8xy7, with VF compared against the new Vx like OP8xy7
+LANE_KERNEL static void SubN(uint8_t *vx, uint8_t const *vy, uint8_t *vf, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        vx[l] = mask[l] ? static_cast<uint8_t>(vy[l] - vx[l]) : vx[l];
+        vf[l] = mask[l] ? static_cast<uint8_t>(vy[l] >= vx[l]) : vf[l];
+    }
+}
+
+// 8xy6
+LANE_KERNEL static void ShiftRight(uint8_t *vx, uint8_t const *vy, uint8_t *vf, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        uint8_t a = vy[l];
+        vx[l] = mask[l] ? static_cast<uint8_t>(a >> 1) : vx[l];
+        vf[l] = mask[l] ? static_cast<uint8_t>(a & 1) : vf[l];
+    }
+}
+
+// 8xyE
+LANE_KERNEL static void ShiftLeft(uint8_t *vx, uint8_t const *vy, uint8_t *vf, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+    {
+        uint8_t a = vy[l];
+        vx[l] = mask[l] ? static_cast<uint8_t>(a << 1) : vx[l];
+        vf[l] = mask[l] ? static_cast<uint8_t>(a >> 7) : vf[l];
+    }
+}
+
+// 3xkk / 4xkk: skip when (Vx == kk) == equal
+LANE_KERNEL static void SkipConst(uint16_t *pc, uint8_t const *vx, uint8_t kk, bool equal, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        pc[l] += mask[l] & ((vx[l] == kk) == equal ? 2 : 0);
+}
+
+// 5xy0 / 9xy0: skip when (Vx == Vy) == equal
+LANE_KERNEL static void SkipReg(uint16_t *pc, uint8_t const *vx, uint8_t const *vy, bool equal, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        pc[l] += mask[l] & ((vx[l] == vy[l]) == equal ? 2 : 0);
+}
+
+// 1nnn. Lanes jumping to themselves go idle (running cleared). Lanes that
+// jumped back two instructions, which may be a timer wait, are flagged in
+// back; returns how many.
+LANE_KERNEL static size_t Jump(uint16_t *pc, uint16_t nnn, uint8_t *running, uint8_t *back, uint8_t const *mask,
+                               size_t n)
+{
+    size_t count = 0;
+    for (size_t l = 0; l < n; ++l)
+    {
+        uint16_t from = pc[l] - 2;
+        running[l] &= ~(mask[l] & (from == nnn ? 0xFF : 0x00));
+        back[l] = mask[l] & (from == nnn + 4 ? 0xFF : 0x00);
+        count += back[l] & 1;
+        pc[l] = mask[l] ? nnn : pc[l];
+    }
+    return count;
+}
+
+// Annn
+LANE_KERNEL static void SetIndex(uint16_t *index, uint16_t value, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        index[l] = mask[l] ? value : index[l];
+}
+
+// Fx1E
+LANE_KERNEL static void AddIndex(uint16_t *index, uint8_t const *vx, uint8_t const *mask, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        index[l] += mask[l] & vx[l];
+}
+
+LANE_KERNEL static void CountDown(uint8_t *timer, size_t n)
+{
+    for (size_t l = 0; l < n; ++l)
+        timer[l] -= timer[l] > 0;
+}
+
+Chip8Lanes::Chip8Lanes(size_t count)
+    : count(count), memory(count * MEMORY_SIZE), screen(count * SCREEN_ROWS)
+{
+    for (auto &reg : v)
+        reg.assign(count, 0);
+    for (auto &entry : stack)
+        entry.assign(count, 0);
+    for (auto &key : keypad)
+        key.assign(count, 0);
+
+    pc.assign(count, 0x200);
+    I.assign(count, 0);
+    sp.assign(count, 0);
+    delay.assign(count, 0);
+    sound.assign(count, 0);
+    waitKey.assign(count, -1);
+    rng.resize(count);
+
+    running.resize(count);
+    pending.resize(count);
+    mask.resize(count);
+    back.resize(count);
+    opcode.resize(count);
+}
+
+void Chip8Lanes::Load(size_t lane, Chip8 const &chip)
+{
+    for (uint32_t a = 0; a < MEMORY_SIZE; ++a)
+        Memory(lane, a) = chip.memory[a];
+
+    for (int r = 0; r < 16; ++r)
+    {
+        v[r][lane] = chip.registers[r];
+        stack[r][lane] = chip.stack[r];
+        keypad[r][lane] = chip.keypad[r];
+    }
+    pc[lane] = chip.pc;
+    I[lane] = chip.IR;
+    sp[lane] = chip.sp;
+    delay[lane] = chip.d_timer;
+    sound[lane] = chip.s_timer;
+    rng[lane] = chip.randGen;
+    waitKey[lane] = chip.waitKey;
+
+    std::copy_n(chip.screen, SCREEN_ROWS, Screen(lane));
+}
+
+void Chip8Lanes::Store(size_t lane, Chip8 &chip) const
+{
+    for (uint32_t a = 0; a < MEMORY_SIZE; ++a)
+        chip.memory[a] = Memory(lane, a);
+    chip.Invalidate(0, MEMORY_SIZE);
+
+    for (int r = 0; r < 16; ++r)
+    {
+        chip.registers[r] = v[r][lane];
+        chip.stack[r] = stack[r][lane];
+        chip.keypad[r] = keypad[r][lane];
+    }
+    chip.pc = pc[lane];
+    chip.IR = I[lane];
+    chip.sp = sp[lane];
+    chip.d_timer = delay[lane];
+    chip.s_timer = sound[lane];
+    chip.randGen = rng[lane];
+    chip.waitKey = waitKey[lane];
+
+    std::copy_n(Screen(lane), SCREEN_ROWS, chip.screen);
+    chip.dirtyRows = ~0u;
+
+    chip.cycles = cycles;
+    chip.ips = ips;
+    chip.timerPhase = timerPhase;
+    chip.clipSprites = clipSprites;
+}
+
+void Chip8Lanes::Seed(size_t lane, uint64_t seed)
+{
+    rng[lane].Seed(seed);
+}
+
+void Chip8Lanes::Step(uint32_t count)
+{
+    std::fill(running.begin(), running.end(), 0xFF);
+
+    for (uint32_t i = 0; i < count && StepOnce(); ++i)
+    {
+    }
+
+    cycles += count;
+}
+
+void Chip8Lanes::TickTimers()
+{
+    CountDown(delay.data(), count);
+    CountDown(sound.data(), count);
+}
+
+// Same arithmetic as Scheduler::RunFrames and RunUntil
+void Chip8Lanes::RunFrames(uint32_t frames)
+{
+    uint32_t const hz = Scheduler::TIMER_HZ;
+
+    for (uint32_t i = 0; i < frames; ++i)
+    {
+        uint64_t span = timerPhase >= ips ? 0 : (ips - timerPhase + hz - 1) / hz;
+        span = std::max<uint64_t>(span, 1);
+
+        Step(static_cast<uint32_t>(span));
+        timerPhase += static_cast<uint32_t>(span) * hz;
+
+        while (timerPhase >= ips)
+        {
+            timerPhase -= ips;
+            TickTimers();
+        }
+    }
+}
+
+bool Chip8Lanes::StepOnce()
+{
+    if (Fetch(memory.data(), pc.data(), running.data(), pending.data(), opcode.data(), count) == 0)
+        return false;
+
+    // One masked pass per distinct opcode
+    for (size_t l = 0; l < count; ++l)
+    {
+        l = std::find(pending.begin() + l, pending.end(), 0xFF) - pending.begin();
+        if (l == count)
+            break;
+
+        GroupMask(opcode.data(), opcode[l], pending.data(), mask.data(), count);
+        Execute(opcode[l], mask.data());
+    }
+    return true;
+}
+
+void Chip8Lanes::Execute(uint16_t op, uint8_t const *m)
+{
+    uint8_t x = (op >> 8u) & 0xF;
+    uint8_t y = (op >> 4u) & 0xF;
+    uint8_t kk = op & 0xFF;
+    uint16_t nnn = op & 0xFFF;
+    uint8_t *vx = v[x].data();
+    uint8_t *vy = v[y].data();
+    uint8_t *vf = v[0xF].data();
+    size_t n = count;
+
+    switch (DecodeOpcode(op))
+    {
+    case OP_3xkk: SkipConst(pc.data(), vx, kk, true, m, n); break;
+    case OP_4xkk: SkipConst(pc.data(), vx, kk, false, m, n); break;
+    case OP_5xy0: SkipReg(pc.data(), vx, vy, true, m, n); break;
+    case OP_9xy0: SkipReg(pc.data(), vx, vy, false, m, n); break;
+    case OP_6xkk: SetConst(vx, kk, m, n); break;
+    case OP_7xkk: AddConst(vx, kk, m, n); break;
+    case OP_8xy0: Move(vx, vy, m, n); break;
+    case OP_8xy1: Or(vx, vy, m, n); break;
+    case OP_8xy2: And(vx, vy, m, n); break;
+    case OP_8xy3: Xor(vx, vy, m, n); break;
+    case OP_8xy4: AddCarry(vx, vy, vf, m, n); break;
+    case OP_8xy5: Sub(vx, vy, vf, m, n); break;
+    case OP_8xy6: ShiftRight(vx, vy, vf, m, n); break;
+    case OP_8xy7: SubN(vx, vy, vf, m, n); break;
+    case OP_8xyE: ShiftLeft(vx, vy, vf, m, n); break;
+    case OP_1nnn:
+        if (Jump(pc.data(), nnn, running.data(), back.data(), m, n) > 0)
+        {
+            for (size_t l = 0; l < n; ++l)
+                if (back[l] && IsTimerWait(l, nnn, nnn + 4))
+                    running[l] = 0;
+        }
+        break;
+    case OP_Annn: SetIndex(I.data(), nnn, m, n); break;
+    case OP_Fx07: Move(vx, delay.data(), m, n); break;
+    case OP_Fx15: Move(delay.data(), vx, m, n); break;
+    case OP_Fx18: Move(sound.data(), vx, m, n); break;
+    case OP_Fx1E: AddIndex(I.data(), vx, m, n); break;
+    case OP_NULL: break; // ignored, like OPNULL
+    default:
+        for (size_t l = 0; l < n; ++l)
+            if (m[l])
+                ExecuteLane(l, op);
+        break;
+    }
+}
+
+// Mirrors the Chip8 handlers. Addresses wrap at 4 KiB where the scalar
+// handlers would read or write past memory.
+void Chip8Lanes::ExecuteLane(size_t l, uint16_t op)
+{
+    uint8_t x = (op >> 8u) & 0xF;
+    uint8_t y = (op >> 4u) & 0xF;
+    uint8_t kk = op & 0xFF;
+    uint16_t nnn = op & 0xFFF;
+
+    switch (DecodeOpcode(op))
+    {
+    case OP_00E0:
+        std::fill_n(Screen(l), SCREEN_ROWS, 0);
+        break;
+
+    case OP_00EE:
+        --sp[l];
+        pc[l] = stack[sp[l] & 0xF][l];
+        break;
+
+    case OP_2nnn:
+        stack[sp[l] & 0xF][l] = pc[l];
+        ++sp[l];
+        pc[l] = nnn;
+        break;
+
+    case OP_Bnnn:
+        pc[l] = nnn + v[0][l];
+        break;
+
+    case OP_Cxkk:
+        v[x][l] = kk & rng[l].Byte();
+        break;
+
+    case OP_Dxyn:
+    {
+        uint8_t sprite[16];
+        for (unsigned row = 0; row < (op & 0xFu); ++row)
+            sprite[row] = Memory(l, (I[l] + row) & 0xFFF);
+
+        v[0xF][l] = DrawSprite(Screen(l), sprite, op & 0xFu, v[x][l] % 64, v[y][l] % SCREEN_ROWS, clipSprites);
+        break;
+    }
+
+    case OP_Ex9E:
+        if (keypad[v[x][l] & 0xF][l])
+            pc[l] += 2;
+        break;
+
+    case OP_ExA1:
+        if (!keypad[v[x][l] & 0xF][l])
+            pc[l] += 2;
+        break;
+
+    case OP_Fx0A:
+    {
+        // Latch the first key down, store it once released; see OPFx0A
+        int8_t &latched = waitKey[l];
+        if (latched < 0)
+        {
+            for (int8_t key = 0; key < 16 && latched < 0; ++key)
+                if (keypad[key][l])
+                    latched = key;
+        }
+        else if (!keypad[latched][l])
+        {
+            v[x][l] = static_cast<uint8_t>(latched);
+            latched = -1;
+            break;
+        }
+
+        pc[l] -= 2;
+        running[l] = 0;
+        break;
+    }
+
+    case OP_Fx29:
+        I[l] = 0x50 + 5 * v[x][l];
+        break;
+
+    case OP_Fx33:
+    {
+        uint8_t val = v[x][l];
+        Memory(l, (I[l] + 2) & 0xFFF) = val % 10;
+        Memory(l, (I[l] + 1) & 0xFFF) = val / 10 % 10;
+        Memory(l, I[l] & 0xFFF) = val / 100;
+        break;
+    }
+
+    case OP_Fx55:
+        for (unsigned i = 0; i <= x; ++i)
+            Memory(l, (I[l] + i) & 0xFFF) = v[i][l];
+        break;
+
+    case OP_Fx65:
+        for (unsigned i = 0; i <= x; ++i)
+            v[i][l] = Memory(l, (I[l] + i) & 0xFFF);
+        break;
+
+    default:
+        break;
+    }
+}
+
+// Same pattern as Chip8::IsTimerWait, on the lane's memory
+bool Chip8Lanes::IsTimerWait(size_t l, uint16_t nnn, uint16_t from) const
+{
+    if (from != nnn + 4 || nnn + 3u >= MEMORY_SIZE)
+        return false;
+
+    uint16_t load = (Memory(l, nnn) << 8u) | Memory(l, nnn + 1);
+    uint16_t skip = (Memory(l, nnn + 2) << 8u) | Memory(l, nnn + 3);
+
+    return (load & 0xF0FFu) == 0xF007u &&
+           ((skip & 0xF000u) == 0x3000u || (skip & 0xF000u) == 0x4000u) &&
+           ((skip ^ load) & 0x0F00u) == 0;
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include "chip8.hpp"
+
+// Many independent CHIP-8 machines stepped in lockstep, for workloads that
+// run thousands of environments (training, fuzzing). State is kept in
+// Structure-of-Arrays form: v[r][lane], pc[lane], ... so one instruction
+// can be applied to every lane that is executing it with a vector loop.
+//
+// Each step fetches one opcode per lane and groups lanes by opcode. Every
+// group runs once with a lane mask; lanes that diverged (different pc or
+// different code) simply sit in another group. Register, I, timer and
+// branch instructions are masked vector kernels; the rest (draw, stack,
+// memory transfers, keys) loop over the lanes in the mask.
+//
+// Lanes follow the scalar core exactly, including faults and Idle: a lane
+// that faults or goes idle sits out the rest of the Step. All lanes share
+// one clock (cycles, ips, timerPhase). chip8-differential checks this
+// against the table core on fuzzed ROMs.
+class Chip8Lanes
+{
+public:
+    static constexpr uint32_t MEMORY_SIZE = 4096;
+    static constexpr uint32_t SCREEN_ROWS = 32;
+
+    explicit Chip8Lanes(size_t count);
+
+    size_t Size() const { return count; }
+
+    // Copy a scalar machine into a lane, and back out. The shared clock and
+    // quirks are copied out too but not in: lanes keep their own.
+    void Load(size_t lane, Chip8 const &chip);
+    void Store(size_t lane, Chip8 &chip) const;
+
+    // Restart a lane's random number generator
+    void Seed(size_t lane, uint64_t seed);
+
+    // Run up to count instructions on every lane
+    void Step(uint32_t count);
+
+    // Decrement every lane's delay and sound timers
+    void TickTimers();
+
+    // Run up to and including the next `frames` 60 Hz timer ticks, the
+    // same way Scheduler::RunFrames does for one machine
+    void RunFrames(uint32_t frames);
+
+    // Screen row of a lane; bit 63 is x = 0
+    uint64_t *Screen(size_t lane) { return &screen[lane * SCREEN_ROWS]; }
+    uint64_t const *Screen(size_t lane) const { return &screen[lane * SCREEN_ROWS]; }
+
+    // Memory is interleaved by address so lanes running the same code
+    // fetch from adjacent bytes
+    uint8_t &Memory(size_t lane, uint32_t addr) { return memory[addr * count + lane]; }
+    uint8_t Memory(size_t lane, uint32_t addr) const { return memory[addr * count + lane]; }
+
+    // Per-lane state, indexed [lane] (or [register][lane])
+    std::vector<uint8_t> v[16];
+    std::vector<uint16_t> pc;
+    std::vector<uint16_t> I;
+    std::vector<uint8_t> sp;
+    std::vector<uint16_t> stack[16];
+    std::vector<uint8_t> delay;
+    std::vector<uint8_t> sound;
+    std::vector<uint8_t> keypad[16];
+    std::vector<int8_t> waitKey;
+    std::vector<Rng> rng;
+
+    // Shared clock, see Chip8::cycles
+    uint64_t cycles = 0;
+    uint32_t ips = 700;
+    uint32_t timerPhase = 0;
+
+    // Quirk shared by all lanes, see Chip8::clipSprites
+    bool clipSprites = false;
+
+private:
+    // Execute one instruction on every running lane. Returns false once
+    // no lane is running.
+    bool StepOnce();
+
+    // Apply opcode to the lanes in mask
+    void Execute(uint16_t opcode, uint8_t const *mask);
+
+    // Scalar fallback for one lane
+    void ExecuteLane(size_t lane, uint16_t opcode);
+
+    bool IsTimerWait(size_t lane, uint16_t nnn, uint16_t from) const;
+
+    size_t count;
+    std::vector<uint8_t> memory; // [addr][lane]
+    std::vector<uint64_t> screen; // SCREEN_ROWS rows per lane
+
+    // Scratch for StepOnce
+    std::vector<uint8_t> running; // 0xFF while the lane is in this Step
+    std::vector<uint8_t> pending; // 0xFF until the lane's group has run
+    std::vector<uint8_t> mask;
+    std::vector<uint8_t> back; // see Jump in lanes.cpp
+    std::vector<uint16_t> opcode;
+};
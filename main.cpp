@@ -1,36 +1,32 @@
 #include <iostream>
 #include "platform.hpp"
-#include "chip8.hpp"
+#include "emulator_thread.hpp"
 
-int main()
+int main(int argc, char **argv)
 {
 
-    Chip8 chip8;
-    Platform platform("cHiP8", &chip8);
+    EmulatorThread emulator;
 
-    while (platform.isOpen())
-    {
-        if (chip8.shouldLoad)
-        {
-            chip8.reset();
-            chip8.LoadRom(chip8.romPath);
-            chip8.romPath = nullptr;
-            chip8.shouldLoad = false;
-            chip8.ready = true;
-        }
-
-        platform.handleEvents();
+    // ./chip8 path/to/rom.ch8 loads the ROM straight away
+    if (argc > 1)
+        emulator.Send({Command::LoadRom, 0, argv[1]});
 
-        if (chip8.ready)
-        {
+    Platform platform("cHiP8", &emulator);
+    emulator.Start();
 
-            platform.processInput(chip8.keypad);
+    // The UI thread only handles events and presents; emulation runs on
+    // its own thread and keeps time even while this loop stalls
+    uint64_t noScreen[32] = {};
 
-            chip8.Cycle();
-            platform.beep();
-        }
+    while (platform.isOpen())
+    {
+        platform.handleEvents();
 
-        platform.display(chip8.screen);
-        sf::sleep(sf::milliseconds(16));
+        Frame const *frame = emulator.TakeFrame();
+        platform.display(frame ? frame->screen : noScreen, frame ? frame->dirtyRows : 0);
+        platform.waitFrame();
     }
+
+    emulator.Stop();
+    PrintPacing(std::cout, platform.pacing());
 }
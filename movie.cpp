@@ -0,0 +1,205 @@
+#include "movie.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <memory>
+
+static constexpr char MOVIE_MAGIC[4] = {'C', '8', 'M', 'V'};
+
+struct MovieHeader
+{
+    char magic[4];    // "C8MV"
+    uint32_t version; // MOVIE_VERSION
+    uint64_t romHash;
+    uint64_t seed;
+    uint32_t ips;
+    uint8_t clipSprites;
+    uint8_t reserved[3];
+    uint64_t cycles;
+    uint64_t finalHash;
+    uint64_t edgeCount;
+    uint32_t snapshotSize; // sizeof(Snapshot), catches layout drift
+    uint32_t reserved2;
+    uint64_t keyframeCount;
+};
+
+struct MovieEdge
+{
+    uint64_t cycle;
+    uint8_t key;
+    uint8_t down;
+    uint8_t reserved[6];
+};
+
+static_assert(sizeof(MovieEdge) == 16, "movie edges are 16 bytes on disk");
+
+bool WriteMovie(char const *path, Movie const &movie, std::string &error)
+{
+    MovieHeader header = {};
+    std::memcpy(header.magic, MOVIE_MAGIC, sizeof(MOVIE_MAGIC));
+    header.version = MOVIE_VERSION;
+    header.romHash = movie.romHash;
+    header.seed = movie.seed;
+    header.ips = movie.ips;
+    header.clipSprites = movie.clipSprites;
+    header.cycles = movie.cycles;
+    header.finalHash = movie.finalHash;
+    header.edgeCount = movie.edges.size();
+    header.snapshotSize = sizeof(Snapshot);
+    header.keyframeCount = movie.keyframes.size();
+
+    std::vector<MovieEdge> edges(movie.edges.size(), MovieEdge{});
+    for (size_t i = 0; i < edges.size(); ++i)
+    {
+        edges[i].cycle = movie.edges[i].cycle;
+        edges[i].key = movie.edges[i].key;
+        edges[i].down = movie.edges[i].down;
+    }
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    out.write(reinterpret_cast<char const *>(edges.data()), edges.size() * sizeof(MovieEdge));
+    out.write(reinterpret_cast<char const *>(movie.keyframes.data()), movie.keyframes.size() * sizeof(Snapshot));
+    if (!out)
+    {
+        error = std::string("cannot write movie ") + path;
+        return false;
+    }
+    return true;
+}
+
+bool ReadMovie(char const *path, Movie &movie, std::string &error)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in)
+    {
+        error = std::string("cannot open movie ") + path;
+        return false;
+    }
+
+    MovieHeader header;
+    if (!in.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+        std::memcmp(header.magic, MOVIE_MAGIC, sizeof(MOVIE_MAGIC)) != 0)
+    {
+        error = std::string("not a movie: ") + path;
+        return false;
+    }
+    if (header.version != MOVIE_VERSION || header.snapshotSize != sizeof(Snapshot))
+    {
+        error = "movie version " + std::to_string(header.version) + " is not supported";
+        return false;
+    }
+
+    std::vector<MovieEdge> edges;
+    edges.resize(header.edgeCount);
+    movie.keyframes.resize(header.keyframeCount);
+    if (!in.read(reinterpret_cast<char *>(edges.data()), edges.size() * sizeof(MovieEdge)) ||
+        !in.read(reinterpret_cast<char *>(movie.keyframes.data()), movie.keyframes.size() * sizeof(Snapshot)))
+    {
+        error = std::string("truncated movie ") + path;
+        return false;
+    }
+
+    movie.romHash = header.romHash;
+    movie.seed = header.seed;
+    movie.ips = header.ips;
+    movie.clipSprites = header.clipSprites != 0;
+    movie.cycles = header.cycles;
+    movie.finalHash = header.finalHash;
+    movie.edges.clear();
+    for (MovieEdge const &edge : edges)
+    {
+        if (edge.key > 0xF || (!movie.edges.empty() && edge.cycle < movie.edges.back().cycle))
+        {
+            error = std::string("corrupt key edges in movie ") + path;
+            return false;
+        }
+        movie.edges.push_back({edge.cycle, edge.key, edge.down != 0});
+    }
+    for (size_t i = 0; i < movie.keyframes.size(); ++i)
+    {
+        uint64_t cycle = movie.keyframes[i].cycles;
+        if (cycle >= movie.cycles || (i > 0 && cycle <= movie.keyframes[i - 1].cycles))
+        {
+            error = std::string("corrupt keyframes in movie ") + path;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool StartMovie(Movie const &movie, char const *rom, Chip8 &chip, std::string &error)
+{
+    chip.reset();
+    chip.randGen.Seed(movie.seed);
+    chip.ips = movie.ips;
+    chip.clipSprites = movie.clipSprites;
+    if (!chip.LoadRom(rom))
+    {
+        error = std::string("cannot load ROM ") + rom;
+        return false;
+    }
+    if (chip.romHash != movie.romHash)
+    {
+        error = std::string("movie was recorded with a different ROM than ") + rom;
+        return false;
+    }
+    return true;
+}
+
+void BeginMovie(Movie &movie, Chip8 const &chip, uint64_t seed)
+{
+    movie = Movie();
+    movie.romHash = chip.romHash;
+    movie.seed = seed;
+    movie.ips = chip.ips;
+    movie.clipSprites = chip.clipSprites;
+}
+
+void AddKeyframe(Movie &movie, Chip8 const &chip)
+{
+    movie.keyframes.emplace_back();
+    chip.SaveState(movie.keyframes.back());
+}
+
+void EndMovie(Movie &movie, Chip8 const &chip)
+{
+    movie.cycles = chip.cycles;
+    movie.finalHash = chip.StateHash();
+    TruncateMovie(movie, movie.cycles);
+}
+
+void TruncateMovie(Movie &movie, uint64_t cycle)
+{
+    auto from = std::lower_bound(movie.edges.begin(), movie.edges.end(), cycle,
+                                 [](KeyEdge const &edge, uint64_t c) { return edge.cycle < c; });
+    movie.edges.erase(from, movie.edges.end());
+
+    auto keyframe = std::lower_bound(movie.keyframes.begin(), movie.keyframes.end(), cycle,
+                                     [](Snapshot const &state, uint64_t c) { return state.cycles < c; });
+    movie.keyframes.erase(keyframe, movie.keyframes.end());
+}
+
+bool ReplaySegment(Movie const &movie, size_t segment, Chip8 &chip)
+{
+    uint64_t start = movie.SegmentStart(segment);
+    uint64_t end = movie.SegmentEnd(segment);
+    if (segment > 0)
+        chip.LoadState(movie.keyframes[segment - 1]);
+
+    Scheduler scheduler(chip);
+    auto edge = std::lower_bound(movie.edges.begin(), movie.edges.end(), start,
+                                 [](KeyEdge const &e, uint64_t c) { return e.cycle < c; });
+    for (; edge != movie.edges.end() && edge->cycle < end; ++edge)
+        scheduler.QueueKey(*edge);
+    scheduler.RunUntil(end);
+
+    if (segment == movie.keyframes.size())
+        return chip.StateHash() == movie.finalHash;
+
+    // Compare through a machine holding the keyframe, so both sides hash
+    // the same way; the clock is not part of the hash
+    auto expected = std::make_unique<Chip8>();
+    expected->LoadState(movie.keyframes[segment]);
+    return chip.StateHash() == expected->StateHash() && chip.timerPhase == expected->timerPhase;
+}
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "chip8.hpp"
+#include "scheduler.hpp"
+
+// Input movies: everything needed to reproduce a run exactly. A movie
+// starts from power-on (Chip8::reset, then the ROM) with the recorded
+// seed, speed and quirks, and replays key edges at the instruction slot
+// they first happened on. Cores produce identical state, so the core is
+// not recorded.
+//
+// Long movies carry keyframes: full snapshots every so often, which split
+// the run into segments that can be replayed and checked independently.
+//
+// File layout (native byte order): MovieHeader, then edgeCount records of
+// 16 bytes (uint64 cycle, uint8 key, uint8 down, 6 zero bytes), then
+// keyframeCount Snapshots.
+
+constexpr uint32_t MOVIE_VERSION = 2;
+
+// Default spacing of keyframes, in 60 Hz frames (ten seconds)
+constexpr uint32_t MOVIE_KEYFRAME_FRAMES = 600;
+
+struct Movie
+{
+    uint64_t romHash = 0;      // Chip8::romHash of the game
+    uint64_t seed = Chip8::DEFAULT_SEED;
+    uint32_t ips = 700;
+    bool clipSprites = false;
+    uint64_t cycles = 0;       // length in instruction slots from power-on
+    uint64_t finalHash = 0;    // Chip8::StateHash after `cycles` slots
+    std::vector<KeyEdge> edges; // in cycle order, all before `cycles`
+
+    // Machine state at points along the run, in cycle order, all before
+    // `cycles`. A keyframe holds the state before any edge at its cycle.
+    std::vector<Snapshot> keyframes;
+
+    // Segment i runs from keyframe i - 1 (power-on for i = 0) to keyframe i
+    // (the end of the movie for the last one)
+    size_t Segments() const { return keyframes.size() + 1; }
+    uint64_t SegmentStart(size_t segment) const { return segment == 0 ? 0 : keyframes[segment - 1].cycles; }
+    uint64_t SegmentEnd(size_t segment) const
+    {
+        return segment < keyframes.size() ? keyframes[segment].cycles : cycles;
+    }
+};
+
+bool WriteMovie(char const *path, Movie const &movie, std::string &error);
+bool ReadMovie(char const *path, Movie &movie, std::string &error);
+
+// Power chip on the way the movie did: reset, seed, settings and ROM.
+// Fails if rom is not the recorded game.
+bool StartMovie(Movie const &movie, char const *rom, Chip8 &chip, std::string &error);
+
+// Begin recording from chip's current state, which must be power-on with
+// the ROM loaded
+void BeginMovie(Movie &movie, Chip8 const &chip, uint64_t seed);
+
+// Add chip's current state as a keyframe
+void AddKeyframe(Movie &movie, Chip8 const &chip);
+
+// Close the recording at chip's current state; later edges and keyframes
+// are dropped
+void EndMovie(Movie &movie, Chip8 const &chip);
+
+// Forget everything recorded from `cycle` on, for a recording that went
+// back in time (rewind)
+void TruncateMovie(Movie &movie, uint64_t cycle);
+
+// Replay one segment on a started chip (see StartMovie) and return whether
+// it ends in the state the movie recorded for it. chip's trace, core and
+// other settings are left as they are.
+bool ReplaySegment(Movie const &movie, size_t segment, Chip8 &chip);
@@ -1,3 +1,5 @@
+#include <algorithm>
+#include <cfloat>
 #include <iostream>
 #include "imgui/imgui.h"
 #include "imgui/imgui-SFML.h"
@@ -7,12 +9,26 @@
 using namespace sf;
 using namespace sf::Keyboard;
 
-Platform::Platform(std::string title, Chip8 *chip) : window(sf::VideoMode({static_cast<unsigned int>(windowWidth * pixelSize), static_cast<unsigned int>(windowHeight * pixelSize)}), title), sBuffer("assets/beep.mp3"), s(sBuffer)
+// CHIP-8 key for each host key; the 4x4 block under 1234 / QWER / ASDF / ZXCV
+static const Scan KEYMAP[16] = {
+    Scan::X, Scan::Num1, Scan::Num2, Scan::Num3,
+    Scan::Q, Scan::W, Scan::E, Scan::A,
+    Scan::S, Scan::D, Scan::Z, Scan::C,
+    Scan::Num4, Scan::R, Scan::F, Scan::V,
+};
+
+// Held to run the game backwards
+static const Scan REWIND_KEY = Scan::Backspace;
+
+Platform::Platform(std::string title, EmulatorThread *emulator) : window(sf::VideoMode({static_cast<unsigned int>(windowWidth * pixelSize), static_cast<unsigned int>(windowHeight * pixelSize)}), title), tone(*emulator)
 {
-    this->chip = chip;
-    window.setFramerateLimit(60);
+    this->emulator = emulator;
+    window.setKeyRepeatEnabled(false);
 
     ImGui::SFML::Init(window, true);
+    layout(window.getSize());
+
+    tone.play();
 }
 
 Platform::~Platform()
@@ -30,9 +46,45 @@ void Platform::handleEvents()
         {
             window.close();
         }
+        else if (const auto *resized = event->getIf<sf::Event::Resized>())
+        {
+            layout(resized->size);
+        }
+        else if (const auto *pressed = event->getIf<sf::Event::KeyPressed>())
+        {
+            if (pressed->scancode == REWIND_KEY)
+                emulator->Send({Command::Rewind, 1});
+            keyEdge(pressed->scancode, true);
+        }
+        else if (const auto *released = event->getIf<sf::Event::KeyReleased>())
+        {
+            if (released->scancode == REWIND_KEY)
+                emulator->Send({Command::Rewind, 0});
+            keyEdge(released->scancode, false);
+        }
+        else if (event->is<sf::Event::FocusLost>())
+        {
+            // Releases will not arrive while another window has focus
+            for (Scan code : KEYMAP)
+                keyEdge(code, false);
+            emulator->Send({Command::Rewind, 0});
+        }
     }
 }
 
+// Largest whole-number scale that fits, with black bars around the rest
+void Platform::layout(sf::Vector2u windowSize)
+{
+    window.setView(sf::View(sf::FloatRect({0.f, 0.f}, sf::Vector2f(windowSize))));
+
+    sf::Vector2u frame = screenTexture.getSize();
+    unsigned scale = std::max(1u, std::min(windowSize.x / frame.x, windowSize.y / frame.y));
+
+    screenSprite.setScale({static_cast<float>(scale), static_cast<float>(scale)});
+    screenSprite.setPosition({(static_cast<float>(windowSize.x) - frame.x * scale) / 2.f,
+                              (static_cast<float>(windowSize.y) - frame.y * scale) / 2.f});
+}
+
 void Platform::clear()
 {
     window.clear(sf::Color::Black);
@@ -43,10 +95,18 @@ bool Platform::isOpen() const
     return window.isOpen();
 }
 
-void Platform::display(void const *buffer)
+void Platform::waitFrame()
+{
+    pacer.Wait();
+}
+
+void Platform::display(uint64_t const *screen, uint32_t dirtyRows)
 {
     ImGui::SFML::Update(window, deltaClock.restart());
 
+    // Settings and registers as of the last emulated frame
+    DebugState state = emulator->Debug();
+
     if (ImGui::BeginMainMenuBar())
     {
         if (ImGui::BeginMenu("File"))
@@ -58,41 +118,135 @@ void Platform::display(void const *buffer)
 
                 char *loadedFilePath = Platform::pickFile();
 
-                std::cout << "File loaded" << std::endl;
-                chip->romPath = loadedFilePath;
-                chip->shouldLoad = true;
+                if (loadedFilePath)
+                {
+                    std::cout << "File loaded" << std::endl;
+                    emulator->Send({Command::LoadRom, 0, loadedFilePath});
+                }
+            }
+            if (ImGui::BeginMenu("Save state", state.ready))
+            {
+                for (uint32_t slot = 1; slot <= EmulatorThread::SAVE_SLOTS; ++slot)
+                    if (ImGui::MenuItem(("Slot " + std::to_string(slot)).c_str()))
+                        emulator->Send({Command::SaveSlot, slot});
+                ImGui::EndMenu();
             }
+            if (ImGui::BeginMenu("Load state", state.ready))
+            {
+                for (uint32_t slot = 1; slot <= EmulatorThread::SAVE_SLOTS; ++slot)
+                    if (ImGui::MenuItem(("Slot " + std::to_string(slot)).c_str()))
+                        emulator->Send({Command::LoadSlot, slot});
+                ImGui::EndMenu();
+            }
+            if (ImGui::MenuItem("Record movie...", nullptr, false, state.ready && !state.recording))
+            {
+                // Restarts the ROM; replay with chip8-headless --replay
+                const char *filters[] = {"*.c8mv"};
+                if (char const *path = tinyfd_saveFileDialog("Record movie", "movie.c8mv", 1, filters, "CHIP-8 movies"))
+                    emulator->Send({Command::Record, 0, path});
+            }
+            if (ImGui::MenuItem("Stop recording", nullptr, false, state.recording))
+                emulator->Send({Command::StopRecord});
             if (ImGui::MenuItem("Exit"))
             {
                 window.close();
             }
             ImGui::EndMenu();
         }
+        if (ImGui::BeginMenu("Core"))
+        {
+            if (ImGui::MenuItem("Table", nullptr, state.core == Core::Table))
+                emulator->Send({Command::SetCore, static_cast<uint32_t>(Core::Table)});
+            if (ImGui::MenuItem("Threaded", nullptr, state.core == Core::Threaded))
+                emulator->Send({Command::SetCore, static_cast<uint32_t>(Core::Threaded)});
+            if (ImGui::MenuItem("JIT", nullptr, state.core == Core::Jit))
+                emulator->Send({Command::SetCore, static_cast<uint32_t>(Core::Jit)});
+
+            ImGui::Separator();
+            int ips = static_cast<int>(state.ips);
+            if (ImGui::SliderInt("IPS", &ips, 60, 5000))
+                emulator->Send({Command::SetIps, static_cast<uint32_t>(ips)});
+
+            // Frames shown ahead of the real state; 0 is off
+            int runAhead = state.runAhead;
+            if (ImGui::SliderInt("Run-ahead", &runAhead, 0, EmulatorThread::MAX_RUN_AHEAD))
+                emulator->Send({Command::SetRunAhead, static_cast<uint32_t>(runAhead)});
+            ImGui::EndMenu();
+        }
+        if (ImGui::BeginMenu("Debug"))
+        {
+            ImGui::MenuItem("Registers", nullptr, &showDebugger);
+            ImGui::MenuItem("Frame pacing", nullptr, &showPacing);
+            ImGui::EndMenu();
+        }
         ImGui::EndMainMenuBar();
     }
 
-    const uint32_t *pixels = static_cast<const uint32_t *>(buffer);
+    if (showDebugger)
+        debugWindow(state);
+    if (showPacing)
+        pacingWindow();
+
+    // Most frames change nothing; re-expand and upload only the rows that
+    // did, as one update() of the span between the first and last
+    if (dirtyRows)
+    {
+        // RGBA bytes in memory: white, and opaque black
+        ExpandFramebuffer(screen, pixels, 0xFFFFFFFF, 0xFF000000, dirtyRows);
+
+        unsigned first = __builtin_ctz(dirtyRows);
+        unsigned last = 31 - __builtin_clz(dirtyRows);
+        screenTexture.update(reinterpret_cast<std::uint8_t const *>(&pixels[first * windowWidth]),
+                             {static_cast<unsigned>(windowWidth), last - first + 1}, {0, first});
+    }
 
     window.clear();
-    sf::RectangleShape pixelShape({(float)pixelSize, (float)pixelSize});
-    pixelShape.setFillColor(sf::Color::White);
+    window.draw(screenSprite);
 
-    // Fixed: Use windowWidth and windowHeight directly (64x32)
-    for (int y = 0; y < windowHeight; ++y)
+    ImGui::SFML::Render(window);
+
+    window.display();
+}
+
+void Platform::debugWindow(DebugState const &state)
+{
+    if (ImGui::Begin("Registers", &showDebugger))
     {
-        for (int x = 0; x < windowWidth; ++x)
+        ImGui::Text("PC %03X  I %03X  SP %X", state.pc, state.I, state.sp);
+        ImGui::Text("DT %3u  ST %3u", state.delay, state.sound);
+        ImGui::Text("cycles %llu", static_cast<unsigned long long>(state.cycles));
+        ImGui::Text("rewind %.1f s%s", state.history / 60.0, state.rewinding ? " (rewinding)" : "");
+        ImGui::Separator();
+
+        for (int r = 0; r < 16; ++r)
         {
-            if (pixels[y * windowWidth + x])
-            {
-                pixelShape.setPosition(sf::Vector2<float>(x * pixelSize, y * pixelSize));
-                window.draw(pixelShape);
-            }
+            ImGui::Text("V%X %02X", r, state.v[r]);
+            if (r % 4 != 3)
+                ImGui::SameLine();
         }
+        ImGui::Separator();
+
+        for (int i = 0; i < state.sp && i < 16; ++i)
+            ImGui::Text("stack[%d] %03X", i, state.stack[i]);
     }
+    ImGui::End();
+}
 
-    ImGui::SFML::Render(window);
+void Platform::pacingWindow()
+{
+    if (ImGui::Begin("Frame pacing", &showPacing))
+    {
+        float buckets[FramePacer::BUCKETS];
+        for (int i = 0; i < FramePacer::BUCKETS; ++i)
+            buckets[i] = static_cast<float>(pacer.histogram[i]);
 
-    window.display();
+        ImGui::Text("%.1f Hz, %llu frames, %llu overruns", pacer.Hz(),
+                    static_cast<unsigned long long>(pacer.frames), static_cast<unsigned long long>(pacer.overruns));
+        ImGui::Text("worst jitter %.0f us", pacer.worstJitter * 1e6);
+        ImGui::PlotHistogram("##jitter", buckets, FramePacer::BUCKETS, 0, "jitter, 100 us buckets", 0.0f, FLT_MAX,
+                             ImVec2(0, 80));
+    }
+    ImGui::End();
 }
 
 char *Platform::pickFile()
@@ -108,53 +262,16 @@ char *Platform::pickFile()
     return filePath;
 }
 
-void Platform::processInput(uint8_t *keys)
-{
-    for (int i = 0; i < 16; i++)
-        keys[i] = 0;
-
-    if (isKeyPressed(Scan::Num1))
-        keys[0x1] = 1;
-    if (isKeyPressed(Scan::Num2))
-        keys[0x2] = 1;
-    if (isKeyPressed(Scan::Num3))
-        keys[0x3] = 1;
-    if (isKeyPressed(Scan::Num4))
-        keys[0xc] = 1;
-
-    if (isKeyPressed(Scan::Q))
-        keys[0x4] = 1;
-    if (isKeyPressed(Scan::W))
-        keys[0x5] = 1;
-    if (isKeyPressed(Scan::E))
-        keys[0x6] = 1;
-    if (isKeyPressed(Scan::R))
-        keys[0xd] = 1;
-
-    if (isKeyPressed(Scan::A))
-        keys[0x7] = 1;
-    if (isKeyPressed(Scan::S))
-        keys[0x8] = 1;
-    if (isKeyPressed(Scan::D))
-        keys[0x9] = 1;
-    if (isKeyPressed(Scan::F))
-        keys[0xe] = 1;
-
-    if (isKeyPressed(Scan::Z))
-        keys[0xa] = 1;
-    if (isKeyPressed(Scan::X))
-        keys[0x0] = 1;
-    if (isKeyPressed(Scan::C))
-        keys[0xb] = 1;
-    if (isKeyPressed(Scan::V))
-        keys[0xf] = 1;
-}
-
-void Platform::beep()
+// Queue a press or release for the emulator, stamped with the time it was
+// seen so it lands on the matching instruction
+void Platform::keyEdge(Scan code, bool down)
 {
-
-    if (chip->s_timer > 0)
+    for (uint32_t key = 0; key < 16; ++key)
     {
-        s.play();
+        if (KEYMAP[key] != code || ((keysDown >> key) & 1) == down)
+            continue;
+
+        if (emulator->Send({Command::KeyEdge, key | (down ? 0x100u : 0u), {}, HostTime()}))
+            keysDown ^= 1u << key;
     }
-}
\ No newline at end of file
+}
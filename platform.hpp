@@ -3,7 +3,9 @@
 #include <SFML/Graphics.hpp>
 #include <SFML/Audio.hpp>
 #include <string>
-#include "chip8.hpp"
+#include "audio.hpp"
+#include "emulator_thread.hpp"
+#include "frame_pacer.hpp"
 
 class Platform
 {
@@ -14,22 +16,38 @@ private:
     sf::RenderWindow window;
     sf::Clock deltaClock;
 
-    std::string soundPath = "assets/beep.mp3";
+    ToneStream tone;
 
-    sf::SoundBuffer sBuffer;
-    sf::Sound s;
+    EmulatorThread *emulator;
+    uint32_t keysDown = 0; // keys the emulator was last told are down
+    bool showDebugger = false;
+    bool showPacing = false;
 
-    Chip8 *chip;
+    // Presents at 60 Hz; replaces setFramerateLimit
+    FramePacer pacer{60.0};
+
+    // Expanded copy of the emulated screen; only dirty rows are refreshed
+    uint32_t pixels[64 * 32] = {};
+
+    // The emulated screen lives in one texture, drawn as a single sprite
+    // scaled by a whole number and centred in the window
+    sf::Texture screenTexture{sf::Vector2u(windowWidth, windowHeight)};
+    sf::Sprite screenSprite{screenTexture};
+
+    void layout(sf::Vector2u windowSize);
+    void debugWindow(DebugState const &state);
+    void pacingWindow();
+    void keyEdge(sf::Keyboard::Scancode code, bool down);
 
 public:
-    Platform(std::string title, Chip8 *chip);
+    Platform(std::string title, EmulatorThread *emulator);
     ~Platform();
 
     void handleEvents();
     void clear();
-    void display(void const *buffer);
+    void display(uint64_t const *screen, uint32_t dirtyRows);
     bool isOpen() const;
-    void processInput(uint8_t *keys);
-    void beep();
+    void waitFrame();
+    FramePacer const &pacing() const { return pacer; }
     static char *pickFile();
 };
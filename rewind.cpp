@@ -0,0 +1,134 @@
+#include "rewind.hpp"
+#include <cstring>
+
+static_assert(std::is_trivially_copyable_v<Snapshot>, "snapshots are diffed as raw bytes");
+
+static void PutLength(std::vector<uint8_t> &out, size_t value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+static size_t GetLength(uint8_t const *&in)
+{
+    size_t value = 0;
+    for (int shift = 0;; shift += 7)
+    {
+        uint8_t byte = *in++;
+        value |= static_cast<size_t>(byte & 0x7F) << shift;
+        if (byte < 0x80)
+            return value;
+    }
+}
+
+// Append the RLE of a XOR b
+static void EncodeDelta(uint8_t const *a, uint8_t const *b, size_t size, std::vector<uint8_t> &out)
+{
+    size_t i = 0;
+    while (i < size)
+    {
+        size_t start = i;
+
+        // Equal bytes, a word at a time while possible
+        while (i + 8 <= size && std::memcmp(a + i, b + i, 8) == 0)
+            i += 8;
+        while (i < size && a[i] == b[i])
+            ++i;
+        size_t zeros = i - start;
+        if (i == size)
+            break;
+
+        // Changed bytes up to the next pair of equal ones
+        size_t literal = i;
+        while (i < size && !(a[i] == b[i] && (i + 1 == size || a[i + 1] == b[i + 1])))
+            ++i;
+
+        PutLength(out, zeros);
+        PutLength(out, i - literal);
+        for (size_t j = literal; j < i; ++j)
+            out.push_back(a[j] ^ b[j]);
+    }
+}
+
+// XOR an encoded delta into state
+static void ApplyDelta(uint8_t const *in, uint8_t const *end, uint8_t *state)
+{
+    while (in < end)
+    {
+        state += GetLength(in);
+        size_t literal = GetLength(in);
+        for (size_t j = 0; j < literal; ++j)
+            *state++ ^= *in++;
+    }
+}
+
+RewindBuffer::RewindBuffer(size_t budget) : budget(budget)
+{
+}
+
+void RewindBuffer::Push(Snapshot const &state)
+{
+    if (groups.empty() || groups.back().ends.size() + 1 >= KEYFRAME_INTERVAL)
+    {
+        groups.emplace_back();
+        groups.back().keyframe = state;
+        bytes += sizeof(Snapshot);
+    }
+    else
+    {
+        Group &group = groups.back();
+        size_t before = group.deltas.size();
+        EncodeDelta(reinterpret_cast<uint8_t const *>(&state), reinterpret_cast<uint8_t const *>(&group.keyframe),
+                    sizeof(Snapshot), group.deltas);
+        group.ends.push_back(static_cast<uint32_t>(group.deltas.size()));
+        bytes += group.deltas.size() - before + sizeof(uint32_t);
+    }
+    ++frames;
+
+    // Forget the oldest group, never the one being written
+    while (bytes > budget && groups.size() > 1)
+    {
+        Group const &oldest = groups.front();
+        bytes -= sizeof(Snapshot) + oldest.deltas.size() + oldest.ends.size() * sizeof(uint32_t);
+        frames -= 1 + oldest.ends.size();
+        groups.pop_front();
+    }
+}
+
+bool RewindBuffer::Pop(Snapshot &state)
+{
+    if (groups.empty())
+        return false;
+
+    Group &group = groups.back();
+    if (group.ends.empty())
+    {
+        state = group.keyframe;
+        groups.pop_back();
+        bytes -= sizeof(Snapshot);
+    }
+    else
+    {
+        size_t end = group.ends.back();
+        group.ends.pop_back();
+        size_t start = group.ends.empty() ? 0 : group.ends.back();
+
+        state = group.keyframe;
+        ApplyDelta(group.deltas.data() + start, group.deltas.data() + end, reinterpret_cast<uint8_t *>(&state));
+        group.deltas.resize(start);
+        bytes -= end - start + sizeof(uint32_t);
+    }
+    --frames;
+    return true;
+}
+
+void RewindBuffer::Clear()
+{
+    groups.clear();
+    frames = 0;
+    bytes = 0;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+#include "chip8.hpp"
+
+// History of machine states for rewinding, one Snapshot per frame.
+//
+// Frames are kept in groups: a full keyframe followed by up to
+// KEYFRAME_INTERVAL - 1 deltas. A delta is the frame XOR the keyframe,
+// run-length encoded as (zero run, literal run, literal bytes) with varint
+// lengths; memory and screen barely change between frames, so most deltas
+// are a few dozen bytes. Push and Pop each touch one Snapshot and take a
+// few microseconds. When the buffer outgrows its byte budget the oldest
+// group is dropped.
+class RewindBuffer
+{
+public:
+    static constexpr uint32_t KEYFRAME_INTERVAL = 120;
+    static constexpr size_t DEFAULT_BUDGET = 8u << 20;
+
+    explicit RewindBuffer(size_t budget = DEFAULT_BUDGET);
+
+    // Record the newest frame
+    void Push(Snapshot const &state);
+
+    // Take the newest frame back out; false once the history is empty
+    bool Pop(Snapshot &state);
+
+    void Clear();
+
+    size_t Frames() const { return frames; }
+    size_t Bytes() const { return bytes; }
+
+private:
+    struct Group
+    {
+        Snapshot keyframe;
+        std::vector<uint8_t> deltas;
+        std::vector<uint32_t> ends; // end offset in deltas of each frame after the keyframe
+    };
+
+    size_t budget;
+    size_t frames = 0;
+    size_t bytes = 0;
+    std::deque<Group> groups;
+};
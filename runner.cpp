@@ -0,0 +1,214 @@
+#include "runner.hpp"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include "lanes.hpp"
+#include "scheduler.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <dlfcn.h>
+#endif
+
+bool LoadInputScript(char const *path, std::vector<InputEvent> &events, std::string &error)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        error = std::string("cannot open input script ") + path;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#')
+            continue;
+
+        std::istringstream in(line);
+        uint32_t frame;
+        std::string key;
+        std::string state;
+        if (!(in >> frame >> key >> state) || key.size() != 1 || !std::isxdigit(key[0]) ||
+            (state != "down" && state != "up"))
+        {
+            error = std::string(path) + ":" + std::to_string(lineNumber) + ": expected `frame key down|up`";
+            return false;
+        }
+
+        events.push_back({frame, static_cast<uint8_t>(std::stoi(key, nullptr, 16)), state == "down"});
+    }
+
+    std::stable_sort(events.begin(), events.end(), [](InputEvent const &a, InputEvent const &b)
+                     { return a.frame < b.frame; });
+    return true;
+}
+
+bool ParseCore(std::string const &name, Core &core)
+{
+    if (name == "table")
+        core = Core::Table;
+    else if (name == "threaded")
+        core = Core::Threaded;
+    else if (name == "jit")
+        core = Core::Jit;
+    else if (name == "aot")
+        core = Core::Aot;
+    else
+        return false;
+    return true;
+}
+
+bool LoadAotProgram(char const *path, AotProgram const *&program, std::string &error)
+{
+#if defined(__unix__) || defined(__APPLE__)
+    void *library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!library)
+    {
+        error = std::string("cannot load AOT program: ") + dlerror();
+        return false;
+    }
+
+    program = static_cast<AotProgram const *>(dlsym(library, "CHIP8_AOT_PROGRAM"));
+    if (!program)
+    {
+        error = std::string("no CHIP8_AOT_PROGRAM in ") + path;
+        dlclose(library);
+        return false;
+    }
+    return true;
+#else
+    error = std::string("cannot load AOT program ") + path + ": not supported on this platform";
+    return false;
+#endif
+}
+
+bool SelectCore(RunOptions const &options, Chip8 &chip, std::string &error)
+{
+    chip.core = options.core;
+    if (options.core != Core::Aot)
+        return true;
+
+    if (!options.aot)
+    {
+        error = "the aot core needs an AOT program (--aot)";
+        return false;
+    }
+    if (!chip.AttachAot(options.aot))
+    {
+        error = "the AOT program was not built from " + options.rom;
+        return false;
+    }
+    return true;
+}
+
+bool RunRom(RunOptions const &options, Chip8 &chip, RunResult &result, std::string &error, Movie *record)
+{
+    chip.reset();
+    chip.trace.Clear();
+    chip.ips = options.ips;
+    chip.randGen.Seed(options.seed);
+    if (!chip.LoadRom(options.rom.c_str()))
+    {
+        error = "cannot load ROM " + options.rom;
+        return false;
+    }
+    if (!SelectCore(options, chip, error))
+        return false;
+
+    if (record)
+        BeginMovie(*record, chip, options.seed);
+
+    Scheduler scheduler(chip);
+    uint64_t startCycles = chip.cycles;
+    size_t next = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < options.frames; ++frame)
+    {
+        for (; next < options.input.size() && options.input[next].frame <= frame; ++next)
+        {
+            InputEvent const &event = options.input[next];
+            chip.keypad[event.key] = event.down;
+            if (record)
+                record->edges.push_back({chip.cycles, event.key, event.down});
+        }
+
+        scheduler.RunFrames(1);
+
+        if (record && options.keyframeFrames > 0 && (frame + 1) % options.keyframeFrames == 0)
+            AddKeyframe(*record, chip);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    if (record)
+        EndMovie(*record, chip);
+
+    result.instructions = chip.cycles - startCycles;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.hash = chip.StateHash();
+    std::copy(std::begin(chip.trace.counts), std::end(chip.trace.counts), std::begin(result.faults));
+    return true;
+}
+
+bool RunMovie(RunOptions const &options, Movie const &movie, Chip8 &chip, RunResult &result, std::string &error)
+{
+    if (!StartMovie(movie, options.rom.c_str(), chip, error) || !SelectCore(options, chip, error))
+        return false;
+    chip.trace.Clear();
+
+    Scheduler scheduler(chip);
+    for (KeyEdge const &edge : movie.edges)
+        scheduler.QueueKey(edge);
+
+    auto start = std::chrono::steady_clock::now();
+    scheduler.RunUntil(movie.cycles);
+    auto end = std::chrono::steady_clock::now();
+
+    result.instructions = chip.cycles;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.hash = chip.StateHash();
+    std::copy(std::begin(chip.trace.counts), std::end(chip.trace.counts), std::begin(result.faults));
+    return true;
+}
+
+bool RunRomLanes(RunOptions const &options, size_t lanes, Chip8 &chip, RunResult &result, std::string &error)
+{
+    chip.reset();
+    chip.ips = options.ips;
+    chip.randGen.Seed(options.seed);
+    if (!chip.LoadRom(options.rom.c_str()))
+    {
+        error = "cannot load ROM " + options.rom;
+        return false;
+    }
+
+    Chip8Lanes group(lanes);
+    group.ips = options.ips;
+    for (size_t l = 0; l < lanes; ++l)
+        group.Load(l, chip);
+
+    size_t next = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t frame = 0; frame < options.frames; ++frame)
+    {
+        for (; next < options.input.size() && options.input[next].frame <= frame; ++next)
+        {
+            auto &key = group.keypad[options.input[next].key];
+            std::fill(key.begin(), key.end(), options.input[next].down);
+        }
+
+        group.RunFrames(1);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    group.Store(0, chip);
+    result.instructions = group.cycles * lanes;
+    result.seconds = std::chrono::duration<double>(end - start).count();
+    result.hash = chip.StateHash();
+    return true;
+}
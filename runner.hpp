@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "aot.hpp"
+#include "chip8.hpp"
+#include "movie.hpp"
+
+// Headless execution shared by the command line tools.
+
+// One line of an input script: at the start of `frame` the key goes down
+// or up. Script lines look like `120 a down` (frame, hex key, down|up);
+// blank lines and lines starting with # are ignored.
+struct InputEvent
+{
+    uint32_t frame;
+    uint8_t key;
+    bool down;
+};
+
+bool LoadInputScript(char const *path, std::vector<InputEvent> &events, std::string &error);
+
+// table, threaded, jit or aot
+bool ParseCore(std::string const &name, Core &core);
+
+// Load the output of chip8-aot built as a shared library, e.g.
+// `g++ -shared -fPIC -O2 -I. rom_aot.cpp -o rom_aot.so`, and find its
+// CHIP8_AOT_PROGRAM. The library stays loaded. The tools that call this
+// export the core's symbols (-rdynamic) for the library to link against.
+bool LoadAotProgram(char const *path, AotProgram const *&program, std::string &error);
+
+struct RunOptions
+{
+    std::string rom;
+    uint32_t frames = 600;
+    uint32_t ips = 700;
+    Core core = Core::Table;
+    AotProgram const *aot = nullptr; // blocks for Core::Aot, see LoadAotProgram
+    uint64_t seed = Chip8::DEFAULT_SEED;
+    uint32_t keyframeFrames = MOVIE_KEYFRAME_FRAMES; // when recording a movie
+    std::vector<InputEvent> input;
+};
+
+struct RunResult
+{
+    uint64_t instructions = 0; // instruction slots, including idle ones
+    double seconds = 0.0;      // host time spent emulating
+    uint64_t hash = 0;         // Chip8::StateHash at the end
+
+    // Fault events recorded during the run, per TraceKind
+    uint64_t faults[static_cast<int>(TraceKind::COUNT)] = {};
+};
+
+// Switch chip to options.core once the ROM is loaded. Core::Aot also
+// attaches options.aot, which has to have been built from that ROM.
+bool SelectCore(RunOptions const &options, Chip8 &chip, std::string &error);
+
+// Load the ROM into a freshly reset chip and run it for options.frames
+// 60 Hz frames as fast as possible. With `record`, the run is also written
+// there as a movie.
+bool RunRom(RunOptions const &options, Chip8 &chip, RunResult &result, std::string &error, Movie *record = nullptr);
+
+// Replay a movie of options.rom on options.core as fast as possible.
+// result.hash can be compared against movie.finalHash.
+bool RunMovie(RunOptions const &options, Movie const &movie, Chip8 &chip, RunResult &result, std::string &error);
+
+// Same as RunRom, but on `lanes` copies of the machine stepped in lockstep
+// by Chip8Lanes. instructions counts every lane; chip receives lane 0.
+bool RunRomLanes(RunOptions const &options, size_t lanes, Chip8 &chip, RunResult &result, std::string &error);
@@ -0,0 +1,117 @@
+#include "savestate.hpp"
+#include <cstring>
+#include <fstream>
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static constexpr char SAVE_MAGIC[4] = {'C', '8', 'S', 'V'};
+
+void MakeSaveHeader(SaveHeader &header, uint64_t romHash)
+{
+    std::memcpy(header.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC));
+    header.version = SAVE_VERSION;
+    header.size = sizeof(Snapshot);
+    header.reserved = 0;
+    header.romHash = romHash;
+}
+
+bool CheckSaveHeader(SaveHeader const &header, uint64_t romHash, std::string &error)
+{
+    if (std::memcmp(header.magic, SAVE_MAGIC, sizeof(SAVE_MAGIC)) != 0)
+    {
+        error = "not a save file";
+        return false;
+    }
+    if (header.version != SAVE_VERSION || header.size != sizeof(Snapshot))
+    {
+        error = "save file version " + std::to_string(header.version) + " is not supported";
+        return false;
+    }
+    if (header.romHash != romHash)
+    {
+        error = "save file belongs to a different ROM";
+        return false;
+    }
+    return true;
+}
+
+bool WriteSaveState(char const *path, Chip8 const &chip, std::string &error)
+{
+    SaveFile file;
+    MakeSaveHeader(file.header, chip.romHash);
+    chip.SaveState(file.state);
+
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out.write(reinterpret_cast<char const *>(&file), sizeof(file)))
+    {
+        error = std::string("cannot write save file ") + path;
+        return false;
+    }
+    return true;
+}
+
+bool ReadSaveState(char const *path, uint64_t romHash, Snapshot &state, std::string &error)
+{
+#if defined(__unix__)
+    // Map the file and load straight out of the page cache
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+    {
+        error = std::string("cannot open save file ") + path;
+        return false;
+    }
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size != static_cast<off_t>(sizeof(SaveFile)))
+    {
+        close(fd);
+        error = std::string("wrong size for a save file: ") + path;
+        return false;
+    }
+
+    void *mapped = mmap(nullptr, sizeof(SaveFile), PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapped == MAP_FAILED)
+    {
+        error = std::string("cannot map save file ") + path;
+        return false;
+    }
+
+    auto const *file = static_cast<SaveFile const *>(mapped);
+    bool ok = CheckSaveHeader(file->header, romHash, error);
+    if (ok)
+        state = file->state;
+
+    munmap(mapped, sizeof(SaveFile));
+    return ok;
+#else
+    SaveFile file;
+    std::ifstream in(path, std::ios::binary);
+    if (!in.read(reinterpret_cast<char *>(&file), sizeof(file)) || in.peek() != EOF)
+    {
+        error = std::string("cannot read save file ") + path;
+        return false;
+    }
+
+    if (!CheckSaveHeader(file.header, romHash, error))
+        return false;
+
+    state = file.state;
+    return true;
+#endif
+}
+
+bool ReadSaveState(char const *path, Chip8 &chip, std::string &error)
+{
+    Snapshot state;
+    if (!ReadSaveState(path, chip.romHash, state, error))
+        return false;
+
+    chip.LoadState(state);
+    return true;
+}
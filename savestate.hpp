@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <type_traits>
+#include "chip8.hpp"
+
+// Save files: a small header followed by a Snapshot exactly as it sits in
+// memory, so loading is one memcpy (or a read-only mapping) and both
+// directions take microseconds. Native byte order, for the machine that
+// wrote them.
+
+// Bump whenever Snapshot's layout changes; older files are then refused
+constexpr uint32_t SAVE_VERSION = 2;
+
+struct SaveHeader
+{
+    char magic[4];    // "C8SV"
+    uint32_t version; // SAVE_VERSION
+    uint32_t size;    // sizeof(Snapshot), catches layout drift
+    uint32_t reserved;
+    uint64_t romHash; // Chip8::romHash of the game the state belongs to
+};
+
+struct SaveFile
+{
+    SaveHeader header;
+    Snapshot state;
+};
+
+static_assert(std::is_trivially_copyable_v<SaveFile>, "save files are written and read as raw bytes");
+
+// Fill in a header for the ROM with hash romHash
+void MakeSaveHeader(SaveHeader &header, uint64_t romHash);
+
+// Check that header is a current save file for the ROM with hash romHash
+bool CheckSaveHeader(SaveHeader const &header, uint64_t romHash, std::string &error);
+
+// Write the machine state of chip to path
+bool WriteSaveState(char const *path, Chip8 const &chip, std::string &error);
+
+// Read the state out of a save file for the ROM with hash romHash
+bool ReadSaveState(char const *path, uint64_t romHash, Snapshot &state, std::string &error);
+
+// Load a save file into chip, which must have the same ROM loaded. chip is
+// left untouched when the file is refused.
+bool ReadSaveState(char const *path, Chip8 &chip, std::string &error);
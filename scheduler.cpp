@@ -0,0 +1,77 @@
+#include "scheduler.hpp"
+#include <algorithm>
+
+Scheduler::Scheduler(Chip8 &chip) : chip(chip)
+{
+}
+
+void Scheduler::Reset()
+{
+    carry = 0.0;
+    keyEdges.clear();
+}
+
+void Scheduler::FlushKeys()
+{
+    for (KeyEdge const &edge : keyEdges)
+        chip.keypad[edge.key] = edge.down;
+    keyEdges.clear();
+}
+
+void Scheduler::QueueKey(KeyEdge edge)
+{
+    keyEdges.push_back(edge);
+}
+
+uint64_t Scheduler::CyclesToTick() const
+{
+    if (chip.timerPhase >= chip.ips)
+        return 0;
+    return (chip.ips - chip.timerPhase + TIMER_HZ - 1) / TIMER_HZ;
+}
+
+void Scheduler::Advance(double seconds)
+{
+    carry += std::min(seconds, MAX_ADVANCE) * chip.ips;
+
+    uint64_t count = static_cast<uint64_t>(carry);
+    carry -= static_cast<double>(count);
+
+    RunUntil(chip.cycles + count);
+}
+
+void Scheduler::RunUntil(uint64_t target)
+{
+    while (chip.cycles < target)
+    {
+        // Keys change between instructions, at their exact slot
+        for (; !keyEdges.empty() && keyEdges.front().cycle <= chip.cycles; keyEdges.pop_front())
+            chip.keypad[keyEdges.front().key] = keyEdges.front().down;
+
+        uint64_t span = std::min(target - chip.cycles, CyclesToTick());
+        if (!keyEdges.empty())
+            span = std::min(span, keyEdges.front().cycle - chip.cycles);
+
+        if (span > 0)
+        {
+            uint64_t end = chip.cycles + span;
+            chip.Step(static_cast<int>(span));
+
+            // Slots the core did not use (it stopped on a fault) just pass
+            chip.cycles = end;
+            chip.timerPhase += static_cast<uint32_t>(span) * TIMER_HZ;
+        }
+
+        while (chip.timerPhase >= chip.ips)
+        {
+            chip.timerPhase -= chip.ips;
+            chip.TickTimers();
+        }
+    }
+}
+
+void Scheduler::RunFrames(uint32_t frames)
+{
+    for (uint32_t i = 0; i < frames; ++i)
+        RunUntil(chip.cycles + std::max<uint64_t>(CyclesToTick(), 1));
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include "chip8.hpp"
+
+// Key press or release that takes effect at instruction slot `cycle`
+struct KeyEdge
+{
+    uint64_t cycle;
+    uint8_t key;
+    bool down;
+};
+
+// Runs a Chip8 at chip.ips instructions per second of emulated time, with
+// the delay and sound timers ticking at exactly 60 Hz of that same time.
+// Instruction and timer rates are independent of how often the host calls
+// Advance, so the display can run at any rate and drop or repeat frames.
+class Scheduler
+{
+public:
+    static constexpr uint32_t TIMER_HZ = 60;
+
+    // Host time handed to Advance is capped so a long stall (window drag,
+    // debugger break) does not make emulation try to catch up all at once
+    static constexpr double MAX_ADVANCE = 0.25;
+
+    explicit Scheduler(Chip8 &chip);
+
+    // Emulate `seconds` of host time
+    void Advance(double seconds);
+
+    // Run until chip.cycles reaches target, ticking timers on the way
+    void RunUntil(uint64_t target);
+
+    // Run up to and including the next `frames` timer ticks
+    void RunFrames(uint32_t frames);
+
+    // Forget fractional time carried between Advance calls, and queued keys
+    void Reset();
+
+    // Apply every queued key edge now, ahead of its cycle
+    void FlushKeys();
+
+    // Apply a key edge when chip.cycles reaches edge.cycle; execution stops
+    // at that exact instruction. Edges must be queued in cycle order.
+    void QueueKey(KeyEdge edge);
+
+private:
+    // Instruction slots until the next timer tick is due
+    uint64_t CyclesToTick() const;
+
+    Chip8 &chip;
+    double carry = 0.0;
+    std::deque<KeyEdge> keyEdges;
+};
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+// Single-writer sequence lock for small trivially copyable values. The
+// writer never waits; a reader retries while a write is in progress, so it
+// always gets one consistent copy.
+template <typename T>
+class SeqLock
+{
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock copies T with memcpy");
+
+public:
+    void Store(T const &value)
+    {
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        std::memcpy(&data, &value, sizeof(T));
+
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    T Load() const
+    {
+        T value;
+        uint32_t before;
+        uint32_t after;
+        do
+        {
+            before = sequence.load(std::memory_order_acquire);
+            std::memcpy(&value, &data, sizeof(T));
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return value;
+    }
+
+private:
+    std::atomic<uint32_t> sequence{0};
+    T data{};
+};
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+// Bounded single-producer single-consumer queue. Push and Pop never block
+// or take a lock; Push fails when the queue is full.
+template <typename T, size_t CAPACITY>
+class SpscQueue
+{
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+
+public:
+    // Producer side
+    bool Push(T value)
+    {
+        size_t tail = this->tail.load(std::memory_order_relaxed);
+        if (tail - head.load(std::memory_order_acquire) == CAPACITY)
+            return false;
+
+        slots[tail & (CAPACITY - 1)] = std::move(value);
+        this->tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side
+    bool Pop(T &value)
+    {
+        size_t head = this->head.load(std::memory_order_relaxed);
+        if (head == tail.load(std::memory_order_acquire))
+            return false;
+
+        value = std::move(slots[head & (CAPACITY - 1)]);
+        this->head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    T slots[CAPACITY];
+
+    // Apart so the two threads do not share a cache line
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
@@ -0,0 +1,115 @@
+#include "thread_pool.hpp"
+
+// Pool worker running on this thread, if any. The pool is kept with the
+// index because a task may submit to a different pool, whose queue at the
+// same index is not this thread's.
+struct CurrentWorker
+{
+    ThreadPool const *pool = nullptr;
+    unsigned index = 0;
+};
+static thread_local CurrentWorker currentWorker;
+
+ThreadPool::ThreadPool(unsigned threads)
+{
+    if (threads == 0)
+        threads = 1;
+
+    for (unsigned i = 0; i < threads; ++i)
+        queues.push_back(std::make_unique<Queue>());
+    for (unsigned i = 0; i < threads; ++i)
+        workers.emplace_back(&ThreadPool::Work, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto &worker : workers)
+        worker.join();
+}
+
+void ThreadPool::Submit(std::function<void()> task)
+{
+    unsigned target = currentWorker.pool == this ? currentWorker.index
+                                                 : nextQueue++ % queues.size();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++unfinished;
+    }
+    {
+        std::lock_guard<std::mutex> lock(queues[target]->mutex);
+        queues[target]->tasks.push_back(std::move(task));
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ++queued;
+    }
+    wake.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    idle.wait(lock, [this]
+              { return unfinished == 0; });
+}
+
+bool ThreadPool::Pop(unsigned self, std::function<void()> &task)
+{
+    // Own work first, newest first
+    {
+        Queue &own = *queues[self];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty())
+        {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Then steal the oldest task of another worker
+    for (size_t i = 1; i < queues.size(); ++i)
+    {
+        Queue &victim = *queues[(self + i) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty())
+        {
+            task = std::move(victim.tasks.front());
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::Work(unsigned self)
+{
+    currentWorker = {this, self};
+
+    for (;;)
+    {
+        std::function<void()> task;
+        if (Pop(self, task))
+        {
+            --queued;
+            task();
+
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--unfinished == 0)
+                idle.notify_all();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [this]
+                  { return stopping || queued > 0; });
+        if (stopping && queued == 0)
+            return;
+    }
+}
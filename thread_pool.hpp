@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Work-stealing thread pool. Every worker owns a deque: it takes work from
+// the back of its own deque and, when that is empty, steals from the front
+// of the others'. Tasks submitted from one of the pool's own workers go to
+// that worker's deque.
+class ThreadPool
+{
+public:
+    explicit ThreadPool(unsigned threads);
+    ~ThreadPool();
+
+    ThreadPool(ThreadPool const &) = delete;
+    ThreadPool &operator=(ThreadPool const &) = delete;
+
+    void Submit(std::function<void()> task);
+
+    // Block until every submitted task has finished
+    void Wait();
+
+    unsigned Size() const { return static_cast<unsigned>(workers.size()); }
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    void Work(unsigned self);
+    bool Pop(unsigned self, std::function<void()> &task);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable idle;
+    std::atomic<size_t> queued{0};
+    size_t unfinished = 0; // guarded by mutex
+    std::atomic<unsigned> nextQueue{0};
+    bool stopping = false; // guarded by mutex
+};
@@ -0,0 +1,35 @@
+#include "trace.hpp"
+#include <iomanip>
+
+char const *TraceKindName(TraceKind kind)
+{
+    switch (kind)
+    {
+    case TraceKind::Instruction:
+        return "instruction";
+    case TraceKind::PcOutOfBounds:
+        return "pc_out_of_bounds";
+    case TraceKind::OpcodeZero:
+        return "opcode_zero";
+    case TraceKind::Unimplemented:
+        return "unimplemented_opcode";
+    default:
+        return "unknown";
+    }
+}
+
+void PrintTrace(std::ostream &os, TraceRing const &ring, uint64_t &cursor)
+{
+    if (ring.head - cursor > TraceRing::CAPACITY)
+        cursor = ring.head - TraceRing::CAPACITY;
+
+    for (; cursor < ring.head; ++cursor)
+    {
+        TraceEvent const &e = ring.events[cursor & (TraceRing::CAPACITY - 1)];
+        os << std::hex << "PC: " << e.pc << " Opcode: " << std::setw(4) << std::setfill('0') << e.opcode
+           << std::setfill(' ') << std::dec;
+        if (e.kind != TraceKind::Instruction)
+            os << " " << TraceKindName(e.kind);
+        os << '\n';
+    }
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+
+// Compile-time trace level for the core. Build with
+// -DCHIP8_TRACE_LEVEL=0 (off), 1 (faults, default) or 2 (every instruction).
+// Nothing below the selected level is compiled into the interpreter.
+#ifndef CHIP8_TRACE_LEVEL
+#define CHIP8_TRACE_LEVEL 1
+#endif
+
+enum class TraceLevel : int
+{
+    Off = 0,
+    Faults = 1,
+    Instructions = 2,
+};
+
+constexpr TraceLevel TRACE_LEVEL = static_cast<TraceLevel>(CHIP8_TRACE_LEVEL);
+
+enum class TraceKind : uint8_t
+{
+    Instruction,   // executed instruction (Instructions level only)
+    PcOutOfBounds, // pc outside 0x200..0xffe, execution stopped
+    OpcodeZero,    // opcode 0000 fetched, execution stopped
+    Unimplemented, // unknown opcode, skipped
+    COUNT
+};
+
+// One binary trace record
+struct TraceEvent
+{
+    uint16_t pc;
+    uint16_t opcode;
+    TraceKind kind;
+};
+
+// Fixed-size ring of trace records; the oldest records are overwritten
+struct TraceRing
+{
+    static constexpr uint32_t CAPACITY = 4096; // power of two
+
+    TraceEvent events[CAPACITY];
+
+    // Total records ever pushed; the newest is at (head - 1) % CAPACITY
+    uint64_t head = 0;
+
+    // Fault records ever pushed, per kind
+    uint64_t counts[static_cast<int>(TraceKind::COUNT)] = {};
+
+    void Push(TraceKind kind, uint16_t pc, uint16_t opcode)
+    {
+        events[head & (CAPACITY - 1)] = {pc, opcode, kind};
+        ++head;
+        ++counts[static_cast<int>(kind)];
+    }
+
+    // Position and counts, to undo speculative execution. Records pushed
+    // after Save are forgotten by Restore.
+    struct State
+    {
+        uint64_t head;
+        uint64_t counts[static_cast<int>(TraceKind::COUNT)];
+    };
+
+    State Save() const
+    {
+        State state{head, {}};
+        for (int i = 0; i < static_cast<int>(TraceKind::COUNT); ++i)
+            state.counts[i] = counts[i];
+        return state;
+    }
+
+    void Restore(State const &state)
+    {
+        head = state.head;
+        for (int i = 0; i < static_cast<int>(TraceKind::COUNT); ++i)
+            counts[i] = state.counts[i];
+    }
+
+    void Clear()
+    {
+        head = 0;
+        for (auto &count : counts)
+            count = 0;
+    }
+};
+
+char const *TraceKindName(TraceKind kind);
+
+// Print the records pushed since `cursor` (as far as they are still in the
+// ring) and move `cursor` to the end.
+void PrintTrace(std::ostream &os, TraceRing const &ring, uint64_t &cursor);
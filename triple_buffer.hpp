@@ -0,0 +1,49 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Lock-free triple buffer: one thread writes whole values, another always
+// reads the latest complete one. The writer fills Back() and Publish()es
+// it; the reader calls Acquire() and then reads Front(). Neither side ever
+// waits, and the reader never sees a value that is still being written.
+template <typename T>
+class TripleBuffer
+{
+public:
+    // Writer side: the buffer to fill next
+    T &Back() { return buffers[back]; }
+
+    // Writer side: make Back() the latest value. Returns true if the value
+    // it replaces was never acquired by the reader.
+    bool Publish()
+    {
+        uint8_t previous = middle.exchange(back | FRESH, std::memory_order_acq_rel);
+        back = previous & INDEX;
+        return (previous & FRESH) != 0;
+    }
+
+    // Reader side: switch Front() to the latest published value. Returns
+    // false (and keeps the current Front) when nothing new was published.
+    bool Acquire()
+    {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH))
+            return false;
+
+        uint8_t previous = middle.exchange(front, std::memory_order_acq_rel);
+        front = previous & INDEX;
+        return true;
+    }
+
+    // Reader side
+    T const &Front() const { return buffers[front]; }
+
+private:
+    static constexpr uint8_t INDEX = 0x3;
+    static constexpr uint8_t FRESH = 0x4;
+
+    T buffers[3] = {};
+    uint8_t back = 0;  // owned by the writer
+    uint8_t front = 1; // owned by the reader
+    std::atomic<uint8_t> middle{2};
+};